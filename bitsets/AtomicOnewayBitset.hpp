@@ -0,0 +1,190 @@
+/* class AtomicOnewayBitset
+   Author: Jan Kessler (2019)
+
+   Thread-safe variant of OnewayBitset, for use as a shared mask that many threads set bits in.
+*/
+
+#ifndef ATOMIC_ONEWAY_BITSET_HPP
+#define ATOMIC_ONEWAY_BITSET_HPP
+
+#include "OnewayBitset.hpp"
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <climits>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+
+template <
+    typename SizeT, /* integral index type (e.g. int or size_t) */
+    typename AllocT /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    >
+struct AtomicOnewayBitset
+// Like OnewayBitset, but set() and merge() may be called concurrently from any number
+// of threads. Bits are set with a lock-free fetch_or on the block and the "any bit set"
+// flag is a relaxed atomic. Because bits only ever go from 0 to 1, no stronger ordering
+// is necessary among setters: every fetch_or commutes with every other one.
+//
+// Reads (get, count, any, ...) are safe during concurrent setting, but of course they
+// only see some snapshot of the bits set so far. Since the flag is raised after the bit
+// is set, any()/none() may lag behind the bits that get()/count()/forEachSet() see, so
+// the latter scan the blocks and never rely on the flag. reset() and setAll() must not run
+// concurrently with other operations on the same bitset, i.e. call them between
+// synchronization points (e.g. after joining the worker threads).
+//
+// To avoid needless cache line transfers, set() first checks (relaxed) whether the bit
+// or the flag is already set and then skips the atomic RMW. The flag lives in its own
+// cache line, so it isn't falsely shared with the blocks pointer that all setters read.
+// When compiled into a program, remember to link with -pthread.
+{
+    static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
+    static_assert(std::is_integral<AllocT>::value && std::is_unsigned<AllocT>::value, "AllocT must be unsigned integral type.");
+
+    static constexpr AllocT blocksize = static_cast<AllocT>( sizeof(AllocT)*CHAR_BIT );
+    static constexpr AllocT alloct_one = 1;
+    static constexpr AllocT alloct_zero = 0;
+    static constexpr AllocT alloct_all = ~(alloct_zero);
+
+private:
+    // const
+    SizeT _nbits; // number of bits (without padding)
+    SizeT _nblocks; // number of memory blocks
+    AllocT _padblk; // all bits 1, except for the padded bits of the last block
+
+    // variables
+    std::atomic<AllocT> * _blocks;
+    char _flag_pad0[64]; // keep the flag off the cache line(s) of the other members
+    std::atomic<bool> _flag_nonzero;
+    char _flag_pad1[64];
+
+public:
+    // --- Constructors/Destructor (not copyable, share it by reference)
+
+    explicit AtomicOnewayBitset(const SizeT n_bits = 0):
+        _nbits(n_bits > 0 ? n_bits : 0), _nblocks(_nbits > 0 ? (_nbits-1)/blocksize + 1 : 0),
+        _padblk(_nbits%blocksize == 0 ? alloct_all : static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(_nbits%blocksize) ))),
+        _blocks(_nbits > 0 ? new std::atomic<AllocT>[_nblocks] : nullptr), _flag_nonzero(true)
+    {
+        reset();
+    }
+
+    AtomicOnewayBitset(const AtomicOnewayBitset &) = delete;
+    AtomicOnewayBitset& operator=(const AtomicOnewayBitset &) = delete;
+
+    ~AtomicOnewayBitset(){ delete [] _blocks; }
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _nbits; }
+    SizeT getNBlocks() const { return _nblocks; }
+    AllocT getPadBlock() const { return _padblk; }
+    AllocT getBlock(const SizeT blkidx) const { return _blocks[blkidx].load(std::memory_order_relaxed); }
+
+
+    // --- Methods involving this bitfield
+
+    void reset() { // not thread-safe
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { _blocks[blkidx].store(alloct_zero, std::memory_order_relaxed); }
+        _flag_nonzero.store(false, std::memory_order_relaxed);
+    }
+
+    void set(SizeT index) // thread-safe
+    {   // pass 0<=index<_nbits
+        set(index / blocksize, index % blocksize);
+    }
+
+    void set(SizeT blockIndex, SizeT bitIndex) // thread-safe
+    {   // pass 0<=blkidx<_nblocks, 0<=bitidx<blocksize
+        const AllocT mask = static_cast<AllocT>(alloct_one << static_cast<AllocT>(bitIndex));
+        std::atomic<AllocT> &blk = _blocks[blockIndex];
+        if ( !(blk.load(std::memory_order_relaxed) & mask) ) { blk.fetch_or(mask, std::memory_order_relaxed); }
+        _raiseFlag();
+    }
+
+    void setAll() { // not thread-safe
+        if (_nblocks == 0) { return; }
+        for (SizeT blkidx=0; blkidx<_nblocks-1; ++blkidx) { _blocks[blkidx].store(alloct_all, std::memory_order_relaxed); }
+        _blocks[_nblocks-1].store(_padblk, std::memory_order_relaxed);
+        _flag_nonzero.store(true, std::memory_order_relaxed);
+    }
+
+    bool get(SizeT index) const
+    {   // pass 0<=index<_nbits
+        return ( (getBlock(index / blocksize) >> static_cast<AllocT>(index % blocksize)) & alloct_one );
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {   // scans all blocks, as the flag may lag behind concurrent setters
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            AllocT blkval = getBlock(blkidx);
+            while ( blkval ) {
+                callback( static_cast<SizeT>(blkidx*blocksize + blockkernels::ctz64(blkval)) );
+                blkval &= static_cast<AllocT>(blkval-alloct_one);
+            }
+        }
+    }
+
+    bool empty() const { return (_nbits == 0); }
+
+    bool any() const { return _flag_nonzero.load(std::memory_order_relaxed); }
+
+    bool none() const { return !any(); }
+
+    SizeT count() const
+    {   // scans all blocks, as the flag may lag behind concurrent setters
+        SizeT count = 0;
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { count += blockkernels::popcount64(getBlock(blkidx)); }
+        return count;
+    }
+
+
+    // Methods involving this and other bitfield
+
+    void merge(const AtomicOnewayBitset &other) // this |= other, thread-safe w.r.t. concurrent setters on this and other
+    {   // no shortcut via other.none(), its flag may lag behind its bits
+        if (_nbits!=other._nbits) { return; }
+        AllocT merged = alloct_zero;
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            const AllocT val = other.getBlock(blkidx);
+            _orBlock(blkidx, val);
+            merged |= val;
+        }
+        if (merged != alloct_zero) { _raiseFlag(); }
+    }
+
+    template <unsigned Opts, typename StorageT>
+    void merge(const OnewayBitset<SizeT, AllocT, Opts, StorageT> &other) // this |= other, thread-safe w.r.t. concurrent setters on this
+    {
+        if (_nbits!=other.getNBits() || other.none()) { return; }
+        const AllocT * const otherBlocks = other.getBlocks();
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { _orBlock(blkidx, otherBlocks[blkidx]); }
+        _raiseFlag();
+    }
+
+    template <unsigned Opts, typename StorageT>
+    bool equals(const OnewayBitset<SizeT, AllocT, Opts, StorageT> &other) const
+    {
+        if (_nbits!=other.getNBits()) { return false; }
+        const AllocT * const otherBlocks = other.getBlocks();
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            if (getBlock(blkidx) != otherBlocks[blkidx]) { return false; }
+        }
+        return true;
+    }
+
+private:
+    void _raiseFlag() {
+        if ( !_flag_nonzero.load(std::memory_order_relaxed) ) { _flag_nonzero.store(true, std::memory_order_relaxed); }
+    }
+
+    void _orBlock(const SizeT blkidx, const AllocT val) {
+        const AllocT cur = getBlock(blkidx);
+        if ( (cur | val) != cur ) { _blocks[blkidx].fetch_or(val, std::memory_order_relaxed); }
+    }
+};
+
+
+#endif
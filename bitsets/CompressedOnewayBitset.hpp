@@ -0,0 +1,436 @@
+/* class CompressedOnewayBitset
+   Author: Jan Kessler (2019)
+
+   Compressed counterpart of OnewayBitset, with containers in the spirit of:
+   1) S. Chambi, D. Lemire, O. Kaser, R. Godin, "Better bitmap performance with Roaring bitmaps" (2016)
+   2) D. Lemire et al., "Consistently faster and smaller compressed bitmaps with Roaring" (2016)
+*/
+
+#ifndef COMPRESSED_ONEWAY_BITSET_HPP
+#define COMPRESSED_ONEWAY_BITSET_HPP
+
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+template <
+    typename SizeT /* integral index type (e.g. int or size_t) */
+    >
+struct CompressedOnewayBitset
+// A runtime-sized one-way bitset (set bits to 1, merge, evaluate, reset everything),
+// like OnewayBitset, but compressed for very sparse or very clustered bitsets.
+//
+// The index range is split into chunks of 2^16 bits. Untouched chunks cost nothing
+// (besides a pointer in the chunk directory), touched chunks hold one container:
+// - array: sorted 16 bit values, as long as there are at most 4096 of them (<= 8 kB)
+// - bitmap: 1024 words of 64 bits (8 kB), for denser chunks
+// - run: sorted (start, length-1) pairs of 16 bit values, for clustered chunks
+// Arrays turn into bitmaps when they get full. Runs are produced by setAll() and
+// by runOptimize(), which converts every container into its smallest representation,
+// and they turn into bitmaps when they get too fragmented.
+//
+// Every container knows its cardinality and the bitset keeps their sum up to date, so
+// count(), any() and none() are O(1) and reset() just releases the containers.
+{
+    static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
+
+    static constexpr uint32_t chunkbits = 1u << 16; // bits per chunk
+    static constexpr uint32_t array_max = 4096; // max values in array container
+    static constexpr uint32_t bitmap_words = chunkbits/64;
+
+    struct Container
+    {
+        enum Type : uint8_t { array, bitmap, run };
+        Type type;
+        uint32_t card; // number of set bits
+        std::vector<uint16_t> values; // array: sorted values, run: (start, length-1) pairs
+        std::vector<uint64_t> words; // bitmap
+
+        Container(): type(array), card(0) {}
+
+        size_t memoryBytes() const { return sizeof(Container) + values.capacity()*sizeof(uint16_t) + words.capacity()*sizeof(uint64_t); }
+
+        size_t nruns() const { return values.size()/2; }
+
+        bool get(const uint16_t low) const
+        {
+            if (type == bitmap) { return (words[low/64] >> (low%64)) & 1u; }
+            if (type == array) { return std::binary_search(values.begin(), values.end(), low); }
+            const size_t r = _findRun(low);
+            return (r < nruns() && low >= values[2*r] && low <= values[2*r] + values[2*r+1]);
+        }
+
+        void set(const uint16_t low)
+        {
+            if (type == bitmap) {
+                uint64_t &word = words[low/64];
+                const uint64_t mask = uint64_t(1) << (low%64);
+                card += !(word & mask);
+                word |= mask;
+            }
+            else if (type == array) {
+                const auto it = std::lower_bound(values.begin(), values.end(), low);
+                if (it != values.end() && *it == low) { return; }
+                if (card < array_max) {
+                    values.insert(it, low);
+                    ++card;
+                }
+                else { toBitmap(); set(low); }
+            }
+            else { _setRun(low); }
+        }
+
+        template <typename Callback>
+        void forEach(Callback && callback) const // callback(low) for every set bit, ascending
+        {
+            if (type == bitmap) {
+                for (uint32_t w=0; w<bitmap_words; ++w) {
+                    uint64_t word = words[w];
+                    while ( word ) {
+                        callback(static_cast<uint16_t>(w*64 + blockkernels::ctz64(word)));
+                        word &= word-1;
+                    }
+                }
+            }
+            else if (type == array) {
+                for (const uint16_t v : values) { callback(v); }
+            }
+            else {
+                for (size_t r=0; r<nruns(); ++r) {
+                    for (uint32_t v=values[2*r]; v<=uint32_t(values[2*r])+values[2*r+1]; ++v) { callback(static_cast<uint16_t>(v)); }
+                }
+            }
+        }
+
+        void toBitmap()
+        {
+            if (type == bitmap) { return; }
+            std::vector<uint64_t> newwords(bitmap_words, 0);
+            if (type == array) {
+                for (const uint16_t v : values) { newwords[v/64] |= uint64_t(1) << (v%64); }
+            }
+            else {
+                for (size_t r=0; r<nruns(); ++r) { _fillRange(newwords, values[2*r], uint32_t(values[2*r]) + values[2*r+1]); }
+            }
+            words.swap(newwords);
+            std::vector<uint16_t>().swap(values);
+            type = bitmap;
+        }
+
+        void optimize() // convert to the smallest representation
+        {
+            std::vector<uint16_t> runs;
+            uint32_t prev = 0;
+            bool open = false;
+            forEach([&](const uint16_t v) {
+                if (open && v == prev+1) { ++runs.back(); }
+                else { runs.push_back(v); runs.push_back(0); open = true; }
+                prev = v;
+            });
+            const size_t runBytes = runs.size()*sizeof(uint16_t);
+            const size_t arrayBytes = (card <= array_max) ? card*sizeof(uint16_t) : SIZE_MAX;
+            const size_t bitmapBytes = bitmap_words*sizeof(uint64_t);
+            if (runBytes < arrayBytes && runBytes < bitmapBytes) {
+                values.swap(runs);
+                values.shrink_to_fit();
+                std::vector<uint64_t>().swap(words);
+                type = run;
+            }
+            else if (arrayBytes <= bitmapBytes) {
+                if (type != array) {
+                    std::vector<uint16_t> vals;
+                    vals.reserve(card);
+                    forEach([&vals](const uint16_t v) { vals.push_back(v); });
+                    values.swap(vals);
+                    std::vector<uint64_t>().swap(words);
+                    type = array;
+                }
+                values.shrink_to_fit();
+            }
+            else { toBitmap(); }
+        }
+
+        void merge(const Container &other) // this |= other
+        {
+            if (type == array && other.type == array && card + other.card <= array_max) {
+                std::vector<uint16_t> merged;
+                merged.reserve(card + other.card);
+                std::set_union(values.begin(), values.end(), other.values.begin(), other.values.end(), std::back_inserter(merged));
+                values.swap(merged);
+                card = static_cast<uint32_t>(values.size());
+                return;
+            }
+            if (type == run && other.type == array) { // stays run, unless it gets too fragmented
+                for (const uint16_t v : other.values) { set(v); }
+                return;
+            }
+            if (type == array && other.type == run) { _arrayToRuns(); }
+            if (type == run && other.type == run) { _mergeRuns(other); return; }
+            toBitmap();
+            if (other.type == bitmap) {
+                blockkernels::orInto(reinterpret_cast<unsigned char *>(words.data()), reinterpret_cast<const unsigned char *>(other.words.data()), bitmap_words*sizeof(uint64_t));
+            }
+            else if (other.type == array) {
+                for (const uint16_t v : other.values) { words[v/64] |= uint64_t(1) << (v%64); }
+            }
+            else {
+                for (size_t r=0; r<other.nruns(); ++r) { _fillRange(words, other.values[2*r], uint32_t(other.values[2*r]) + other.values[2*r+1]); }
+            }
+            card = static_cast<uint32_t>( blockkernels::popcount(reinterpret_cast<const unsigned char *>(words.data()), bitmap_words*sizeof(uint64_t)) );
+        }
+
+        bool equals(const Container &other) const
+        {
+            if (card != other.card) { return false; }
+            if (type == other.type && type != bitmap) { return values == other.values; } // both canonical
+            std::vector<uint16_t> a, b;
+            a.reserve(card); b.reserve(card);
+            forEach([&a](const uint16_t v) { a.push_back(v); });
+            other.forEach([&b](const uint16_t v) { b.push_back(v); });
+            return a == b;
+        }
+
+    private:
+        size_t _findRun(const uint16_t low) const // index of last run starting at or before low (nruns() if none)
+        {
+            size_t lo = 0, hi = nruns();
+            while (lo < hi) {
+                const size_t mid = (lo + hi)/2;
+                if (values[2*mid] <= low) { lo = mid+1; } else { hi = mid; }
+            }
+            return (lo == 0) ? nruns() : lo-1;
+        }
+
+        void _setRun(const uint16_t low)
+        {
+            const size_t n = nruns();
+            const size_t r = _findRun(low);
+            if (r < n && low <= uint32_t(values[2*r]) + values[2*r+1]) { return; } // already in run r
+            ++card;
+            const bool extendPrev = (r < n && uint32_t(values[2*r]) + values[2*r+1] + 1 == low);
+            const size_t next = (r < n) ? r+1 : 0;
+            const bool extendNext = (next < n && uint32_t(low) + 1 == values[2*next]);
+            if (extendPrev && extendNext) { // low closes the gap between r and next
+                values[2*r+1] = static_cast<uint16_t>(values[2*r+1] + values[2*next+1] + 2);
+                values.erase(values.begin()+2*next, values.begin()+2*next+2);
+            }
+            else if (extendPrev) { ++values[2*r+1]; }
+            else if (extendNext) { values[2*next] = low; ++values[2*next+1]; }
+            else {
+                const uint16_t newrun[2] = {low, 0};
+                values.insert(values.begin()+2*next, newrun, newrun+2);
+                if (nruns() > array_max/2) { toBitmap(); } // too fragmented, a bitmap is smaller
+            }
+        }
+
+        void _arrayToRuns()
+        {
+            std::vector<uint16_t> runs;
+            for (const uint16_t v : values) {
+                if (!runs.empty() && uint32_t(runs[runs.size()-2]) + runs.back() + 1 == v) { ++runs.back(); }
+                else { runs.push_back(v); runs.push_back(0); }
+            }
+            values.swap(runs);
+            type = run;
+        }
+
+        void _mergeRuns(const Container &other)
+        {
+            std::vector<uint16_t> merged;
+            size_t i = 0, j = 0;
+            uint32_t newcard = 0;
+            while (i < nruns() || j < other.nruns()) {
+                const bool takeThis = (j >= other.nruns()) || (i < nruns() && values[2*i] <= other.values[2*j]);
+                const uint32_t start = takeThis ? values[2*i] : other.values[2*j];
+                const uint32_t end = start + (takeThis ? values[2*i+1] : other.values[2*j+1]);
+                takeThis ? ++i : ++j;
+                if (!merged.empty() && start <= uint32_t(merged[merged.size()-2]) + merged.back() + 1) { // overlaps/touches last
+                    const uint32_t lastStart = merged[merged.size()-2];
+                    const uint32_t lastEnd = std::max(lastStart + merged.back(), end);
+                    newcard += lastEnd - (lastStart + merged.back());
+                    merged.back() = static_cast<uint16_t>(lastEnd - lastStart);
+                }
+                else {
+                    merged.push_back(static_cast<uint16_t>(start));
+                    merged.push_back(static_cast<uint16_t>(end - start));
+                    newcard += end - start + 1;
+                }
+            }
+            values.swap(merged);
+            card = newcard;
+            if (nruns() > array_max/2) { toBitmap(); }
+        }
+
+        static void _fillRange(std::vector<uint64_t> &words, const uint32_t first, const uint32_t last) // set bits [first, last]
+        {
+            for (uint32_t v=first; v<=last; ) {
+                if (v%64 == 0 && v+63 <= last) { words[v/64] = ~uint64_t(0); v += 64; }
+                else { words[v/64] |= uint64_t(1) << (v%64); ++v; }
+            }
+        }
+    };
+
+private:
+    SizeT _nbits;
+    std::vector< std::unique_ptr<Container> > _chunks; // chunk directory, nullptr for untouched chunks
+    uint64_t _card; // number of set bits, i.e. sum of the container cardinalities
+
+public:
+    // --- Constructors/Destructor
+
+    explicit CompressedOnewayBitset(const SizeT n_bits = 0):
+        _nbits(n_bits > 0 ? n_bits : 0), _chunks(static_cast<size_t>((static_cast<uint64_t>(_nbits) + chunkbits - 1)/chunkbits)), _card(0)
+    {}
+
+    CompressedOnewayBitset(const CompressedOnewayBitset &other): _nbits(other._nbits), _chunks(other._chunks.size()), _card(other._card)
+    {
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            if (other._chunks[c]) { _chunks[c].reset(new Container(*other._chunks[c])); }
+        }
+    }
+
+    CompressedOnewayBitset(CompressedOnewayBitset &&other) noexcept: _nbits(other._nbits), _chunks(std::move(other._chunks)), _card(other._card)
+    {
+        other._card = 0; // other has no chunks left
+    }
+
+    CompressedOnewayBitset& operator=(CompressedOnewayBitset other) noexcept // copy-and-swap
+    {
+        std::swap(_nbits, other._nbits);
+        _chunks.swap(other._chunks);
+        std::swap(_card, other._card);
+        return *this;
+    }
+
+
+    // --- Overloaded Operators
+
+    CompressedOnewayBitset& operator+=(const CompressedOnewayBitset &other) { this->merge(other); return *this; }
+
+    friend bool operator==(const CompressedOnewayBitset& lhs, const CompressedOnewayBitset& rhs){ return lhs.equals(rhs); }
+    friend bool operator!=(const CompressedOnewayBitset& lhs, const CompressedOnewayBitset& rhs){ return !(lhs.equals(rhs)); }
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _nbits; }
+    size_t getNChunks() const { return _chunks.size(); }
+    const Container * getContainer(const size_t chunk) const { return _chunks[chunk].get(); }
+
+    size_t memoryBytes() const // approximate memory footprint
+    {
+        size_t bytes = sizeof(*this) + _chunks.capacity()*sizeof(_chunks[0]);
+        for (const auto &chunk : _chunks) { if (chunk) { bytes += chunk->memoryBytes(); } }
+        return bytes;
+    }
+
+
+    // --- Methods involving this bitfield
+
+    void reset() // release all containers
+    {
+        if (_card == 0) { return; }
+        for (auto &chunk : _chunks) { chunk.reset(); }
+        _card = 0;
+    }
+
+    void set(SizeT index)
+    {   // pass 0<=index<_nbits
+        std::unique_ptr<Container> &chunk = _chunks[static_cast<size_t>(index/chunkbits)];
+        if (!chunk) { chunk.reset(new Container()); }
+        const uint32_t before = chunk->card;
+        chunk->set(static_cast<uint16_t>(index%chunkbits));
+        _card += chunk->card - before;
+    }
+
+    void setAll() // every chunk becomes a single run
+    {
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            const uint64_t last = std::min(static_cast<uint64_t>(_nbits), static_cast<uint64_t>(c+1)*chunkbits) - static_cast<uint64_t>(c)*chunkbits - 1;
+            _chunks[c].reset(new Container());
+            _chunks[c]->type = Container::run;
+            _chunks[c]->values = {0, static_cast<uint16_t>(last)};
+            _chunks[c]->card = static_cast<uint32_t>(last+1);
+        }
+        _card = static_cast<uint64_t>(_nbits);
+    }
+
+    bool get(SizeT index) const
+    {   // pass 0<=index<_nbits
+        const Container * chunk = _chunks[static_cast<size_t>(index/chunkbits)].get();
+        return chunk && chunk->get(static_cast<uint16_t>(index%chunkbits));
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            if (!_chunks[c]) { continue; }
+            const SizeT offset = static_cast<SizeT>(c*chunkbits);
+            _chunks[c]->forEach([offset, &callback](const uint16_t low) { callback(static_cast<SizeT>(offset + low)); });
+        }
+    }
+
+    void getAll(bool out[] /*out[_nbits]*/) const
+    {
+        std::fill(out, out+_nbits, false);
+        forEachSet([out](const SizeT index) { out[index] = true; });
+    }
+
+    void runOptimize() { for (auto &chunk : _chunks) { if (chunk) { chunk->optimize(); } } }
+
+    bool empty() const { return (_nbits == 0); }
+
+    bool any() const { return (_card > 0); }
+
+    bool none() const { return !any(); }
+
+    bool all() const { return (_nbits > 0 && _card == static_cast<uint64_t>(_nbits)); }
+
+    SizeT count() const { return static_cast<SizeT>(_card); }
+
+
+    // Methods involving this and other bitfield
+
+    void merge(const CompressedOnewayBitset &other) // set this = this | other
+    {
+        if (_nbits!=other._nbits || other._card == 0) { return; }
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            if (!other._chunks[c]) { continue; }
+            if (!_chunks[c]) {
+                _chunks[c].reset(new Container(*other._chunks[c]));
+                _card += _chunks[c]->card;
+            }
+            else {
+                const uint32_t before = _chunks[c]->card;
+                _chunks[c]->merge(*other._chunks[c]);
+                _card += _chunks[c]->card - before;
+            }
+        }
+    }
+
+    bool equals(const CompressedOnewayBitset &other) const
+    {
+        if (_nbits!=other._nbits || _card!=other._card) { return false; }
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            const Container * a = _chunks[c].get();
+            const Container * b = other._chunks[c].get();
+            const uint32_t carda = a ? a->card : 0, cardb = b ? b->card : 0;
+            if (carda != cardb) { return false; }
+            if (carda > 0 && !a->equals(*b)) { return false; }
+        }
+        return true;
+    }
+};
+
+template <typename SizeT> constexpr uint32_t CompressedOnewayBitset<SizeT>::chunkbits;
+template <typename SizeT> constexpr uint32_t CompressedOnewayBitset<SizeT>::array_max;
+template <typename SizeT> constexpr uint32_t CompressedOnewayBitset<SizeT>::bitmap_words;
+
+
+#endif
@@ -0,0 +1,222 @@
+/* class CowOnewayBitset
+   Author: Jan Kessler (2019)
+
+   Chunked copy-on-write variant of OnewayBitset, for cheap snapshots.
+*/
+
+#ifndef COW_ONEWAY_BITSET_HPP
+#define COW_ONEWAY_BITSET_HPP
+
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+template <
+    typename SizeT, /* integral index type (e.g. int or size_t) */
+    typename AllocT, /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    size_t ChunkBytes = 4096 /* bytes per chunk, i.e. the granularity of sharing and copying */
+    >
+struct CowOnewayBitset
+// A runtime-sized one-way bitset (set bits to 1, merge, evaluate, reset everything),
+// like OnewayBitset, but with snapshots that cost next to nothing.
+//
+// The blocks are split into chunks of ChunkBytes (a page by default), which are
+// reference counted and shared between copies: copying (snapshot()) only copies the
+// chunk pointers, and a chunk is cloned by the first write to it after it was shared.
+// So if we snapshot a change mask every N steps, each snapshot only costs the chunks
+// that were modified since the previous one (plus a pointer per chunk), instead of
+// a copy of all blocks.
+//
+// Chunks that are all zero are not allocated at all (nullptr), so sparse masks are
+// smaller too, and reset() just releases the chunks. merge() shares the chunks of the
+// other bitset where this one has none.
+//
+// Like OnewayBitset, a bitset must not be used by several threads at once, but
+// snapshots (i.e. copies sharing chunks) may be read and destroyed in other threads
+// while the original is being modified: shared chunks are never written to.
+{
+    static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
+    static_assert(std::is_integral<AllocT>::value && std::is_unsigned<AllocT>::value, "AllocT must be unsigned integral type.");
+    static_assert(ChunkBytes >= sizeof(AllocT) && ChunkBytes % sizeof(AllocT) == 0, "ChunkBytes must be a multiple of sizeof(AllocT).");
+
+    static constexpr AllocT blocksize = static_cast<AllocT>( sizeof(AllocT)*CHAR_BIT );
+    static constexpr AllocT alloct_one = 1;
+    static constexpr AllocT alloct_zero = 0;
+    static constexpr AllocT alloct_all = ~(alloct_zero);
+    static constexpr size_t chunkblocks = ChunkBytes/sizeof(AllocT); // blocks per chunk
+    static constexpr uint64_t chunkbits = static_cast<uint64_t>(chunkblocks)*blocksize; // bits per chunk
+
+private:
+    struct _Chunk { AllocT blocks[chunkblocks]; };
+
+    SizeT _nbits; // number of bits (without padding)
+    std::vector< std::shared_ptr<_Chunk> > _chunks; // chunk directory, nullptr for all-zero chunks
+
+public:
+    // --- Constructors/Destructor (copies share all chunks)
+
+    explicit CowOnewayBitset(const SizeT n_bits = 0):
+        _nbits(n_bits > 0 ? n_bits : 0), _chunks(static_cast<size_t>((static_cast<uint64_t>(_nbits) + chunkbits - 1)/chunkbits))
+    {}
+
+    CowOnewayBitset(const CowOnewayBitset &other) = default;
+    CowOnewayBitset(CowOnewayBitset &&other) noexcept = default;
+    CowOnewayBitset& operator=(const CowOnewayBitset &other) = default;
+    CowOnewayBitset& operator=(CowOnewayBitset &&other) noexcept = default;
+
+    CowOnewayBitset snapshot() const { return *this; } // same as a copy, proportional to the number of chunks
+
+
+    // --- Overloaded Operators
+
+    CowOnewayBitset& operator+=(const CowOnewayBitset &other) { this->merge(other); return *this; }
+
+    friend bool operator==(const CowOnewayBitset& lhs, const CowOnewayBitset& rhs){ return lhs.equals(rhs); }
+    friend bool operator!=(const CowOnewayBitset& lhs, const CowOnewayBitset& rhs){ return !(lhs.equals(rhs)); }
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _nbits; }
+    size_t getNChunks() const { return _chunks.size(); }
+
+    size_t getNAllocatedChunks() const // chunks that are not all zero
+    {
+        return static_cast<size_t>(std::count_if(_chunks.begin(), _chunks.end(), [](const std::shared_ptr<_Chunk> &chunk) { return static_cast<bool>(chunk); }));
+    }
+
+    size_t getNSharedChunks() const // chunks shared with copies (which the next write to them clones)
+    {
+        return static_cast<size_t>(std::count_if(_chunks.begin(), _chunks.end(), [](const std::shared_ptr<_Chunk> &chunk) { return chunk.use_count() > 1; }));
+    }
+
+    bool sharesChunk(const CowOnewayBitset &other, const size_t chunk) const { return _chunks[chunk] && _chunks[chunk] == other._chunks[chunk]; }
+
+
+    // --- Methods involving this bitfield
+
+    void reset() { for (auto &chunk : _chunks) { chunk.reset(); } } // release all chunks
+
+    void set(SizeT index)
+    {   // pass 0<=index<_nbits
+        const uint64_t blkidx = static_cast<uint64_t>(index) / blocksize;
+        const AllocT mask = static_cast<AllocT>(alloct_one << static_cast<AllocT>(static_cast<uint64_t>(index) % blocksize));
+        const size_t c = static_cast<size_t>(blkidx / chunkblocks);
+        const size_t b = static_cast<size_t>(blkidx % chunkblocks);
+        if (_chunks[c] && (_chunks[c]->blocks[b] & mask)) { return; } // already set, no need to own the chunk
+        _writableChunk(c)[b] |= mask;
+    }
+
+    void setAll() // fresh chunks, so that nothing is copied from shared ones
+    {
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            _chunks[c] = std::make_shared<_Chunk>();
+            const uint64_t firstbit = static_cast<uint64_t>(c)*chunkbits;
+            const uint64_t nbits = std::min(chunkbits, static_cast<uint64_t>(_nbits) - firstbit);
+            const size_t nfull = static_cast<size_t>(nbits / blocksize);
+            std::fill(_chunks[c]->blocks, _chunks[c]->blocks+nfull, alloct_all);
+            if (nbits % blocksize != 0) { _chunks[c]->blocks[nfull] = static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(nbits % blocksize) )); }
+        }
+    }
+
+    bool get(SizeT index) const
+    {   // pass 0<=index<_nbits
+        const uint64_t blkidx = static_cast<uint64_t>(index) / blocksize;
+        const _Chunk * chunk = _chunks[static_cast<size_t>(blkidx / chunkblocks)].get();
+        return chunk && ( (chunk->blocks[blkidx % chunkblocks] >> static_cast<AllocT>(static_cast<uint64_t>(index) % blocksize)) & alloct_one );
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            if (!_chunks[c]) { continue; }
+            for (size_t b=0; b<chunkblocks; ++b) {
+                AllocT blkval = _chunks[c]->blocks[b];
+                while ( blkval ) {
+                    callback( static_cast<SizeT>(c*chunkbits + b*blocksize + blockkernels::ctz64(blkval)) );
+                    blkval &= static_cast<AllocT>(blkval-alloct_one);
+                }
+            }
+        }
+    }
+
+    void getAll(bool out[] /*out[_nbits]*/) const
+    {
+        std::fill(out, out+_nbits, false);
+        forEachSet([out](const SizeT index) { out[index] = true; });
+    }
+
+    bool empty() const { return (_nbits == 0); }
+
+    bool any() const // allocated chunks always have a bit set
+    {
+        for (const auto &chunk : _chunks) { if (chunk) { return true; } }
+        return false;
+    }
+
+    bool none() const { return !any(); }
+
+    bool all() const { return (_nbits > 0 && static_cast<uint64_t>(count()) == static_cast<uint64_t>(_nbits)); }
+
+    SizeT count() const
+    {
+        uint64_t count = 0;
+        for (const auto &chunk : _chunks) {
+            if (chunk) { count += blockkernels::popcount(reinterpret_cast<const unsigned char *>(chunk->blocks), ChunkBytes); }
+        }
+        return static_cast<SizeT>(count);
+    }
+
+
+    // Methods involving this and other bitfield
+
+    void merge(const CowOnewayBitset &other) // set this = this | other
+    {
+        if (_nbits!=other._nbits) { return; }
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            if (!other._chunks[c] || _chunks[c] == other._chunks[c]) { continue; }
+            if (!_chunks[c]) { _chunks[c] = other._chunks[c]; } // share it
+            else { blockkernels::orInto(reinterpret_cast<unsigned char *>(_writableChunk(c)), reinterpret_cast<const unsigned char *>(other._chunks[c]->blocks), ChunkBytes); }
+        }
+    }
+
+    bool equals(const CowOnewayBitset &other) const
+    {
+        if (_nbits!=other._nbits) { return false; }
+        for (size_t c=0; c<_chunks.size(); ++c) {
+            const _Chunk * a = _chunks[c].get();
+            const _Chunk * b = other._chunks[c].get();
+            if (a == b) { continue; } // shared (or both zero)
+            if (!a || !b) { return false; } // allocated chunks are never all zero
+            if (!blockkernels::equal(reinterpret_cast<const unsigned char *>(a->blocks), reinterpret_cast<const unsigned char *>(b->blocks), ChunkBytes)) { return false; }
+        }
+        return true;
+    }
+
+private:
+    AllocT * _writableChunk(const size_t c) // allocate or unshare chunk c (copy-on-write)
+    {
+        std::shared_ptr<_Chunk> &chunk = _chunks[c];
+        if (!chunk) { chunk = std::make_shared<_Chunk>(); } // zeroed
+        else if (chunk.use_count() > 1) { chunk = std::make_shared<_Chunk>(*chunk); }
+        else { std::atomic_thread_fence(std::memory_order_acquire); } // last copy may have been released by another thread, after reading it
+        return chunk->blocks;
+    }
+};
+
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr AllocT CowOnewayBitset<SizeT, AllocT, ChunkBytes>::blocksize;
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr AllocT CowOnewayBitset<SizeT, AllocT, ChunkBytes>::alloct_one;
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr AllocT CowOnewayBitset<SizeT, AllocT, ChunkBytes>::alloct_zero;
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr AllocT CowOnewayBitset<SizeT, AllocT, ChunkBytes>::alloct_all;
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr size_t CowOnewayBitset<SizeT, AllocT, ChunkBytes>::chunkblocks;
+template <typename SizeT, typename AllocT, size_t ChunkBytes> constexpr uint64_t CowOnewayBitset<SizeT, AllocT, ChunkBytes>::chunkbits;
+
+
+#endif
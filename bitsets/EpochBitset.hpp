@@ -0,0 +1,234 @@
+/* class EpochBitset
+   Author: Jan Kessler (2019)
+
+   Alternative to OnewayBitset with O(1) reset, via generation-stamped blocks.
+   The idea is the same as for "sparse sets" / timestamped arrays:
+   1) P. Briggs, L. Torczon, "An efficient representation for sparse sets" (1993)
+*/
+
+#ifndef EPOCH_BITSET_HPP
+#define EPOCH_BITSET_HPP
+
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <limits>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+template <
+    typename SizeT, /* integral index type (e.g. int or size_t) */
+    typename AllocT, /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    typename GenT = uint32_t /* unsigned generation counter type, stored next to every block */
+    >
+struct EpochBitset
+// A runtime-sized one-way bitset like OnewayBitset (see OnewayBitset.hpp), for the
+// same usage pattern: set bits iteratively, then periodically evaluate and reset
+// the entire bitset. The difference is that every block carries the generation
+// ("epoch") in which it was last written. A block with a stale generation reads
+// as all zero, so reset() is a single increment of the current epoch, instead of
+// a fill over the whole memory. Only when the counter wraps around (every 2^32
+// resets with the default GenT) all blocks have to be cleared for real.
+//
+// The price: Every block needs sizeof(GenT) extra bytes (plus padding, so better
+// use uint64_t blocks), set() has to check the stamp of its block and all bulk
+// reads (count, merge, getAll, ...) have to look at the stamps as well. So this
+// pays off when resets dominate, i.e. for huge and sparsely set bitsets.
+{
+    // --- Static Asserts
+    static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
+    static_assert(std::is_integral<AllocT>::value && std::is_unsigned<AllocT>::value, "AllocT must be unsigned integral type.");
+    static_assert(std::is_integral<GenT>::value && std::is_unsigned<GenT>::value, "GenT must be unsigned integral type.");
+
+    // --- Compile-Time Statics
+    static constexpr AllocT blocksize = static_cast<AllocT>( sizeof(AllocT)*CHAR_BIT );
+    static constexpr AllocT alloct_one = 1;
+    static constexpr AllocT alloct_zero = 0;
+    static constexpr AllocT alloct_all = ~(alloct_zero);
+
+    struct Block
+    {
+        AllocT bits;
+        GenT gen; // block is valid only if gen == current epoch
+    };
+
+private:
+    // these are const unless you use assignment operators
+    SizeT _nbits; // number of bits (without padding)
+    SizeT _nblocks; // number of memory blocks
+    AllocT _padblk; // _padblk has all bits 1, except for the padded bits of the last block
+
+    // variables
+    Block * _blocks; // ptr to first block of the bitfield
+    GenT _epoch; // current generation, never 0 (0 marks never-written blocks)
+    bool _flag_zero;
+
+public:
+    // --- Constructors/Destructor
+
+    explicit EpochBitset(const SizeT n_bits = 0):
+        _nbits(n_bits > 0 ? n_bits : 0), _nblocks(_nbits > 0 ? (_nbits-1)/blocksize + 1 : 0),
+        _padblk(_nbits%blocksize == 0 ? alloct_all : static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(_nbits%blocksize) ))),
+        _blocks(_nbits > 0 ? new Block[_nblocks] : nullptr), _epoch(1), _flag_zero(true)
+    {
+        _clearStamps();
+    }
+
+    EpochBitset(const EpochBitset &other):
+        _nbits(other._nbits), _nblocks(other._nblocks), _padblk(other._padblk),
+        _blocks(new Block[_nblocks]), _epoch(other._epoch), _flag_zero(other._flag_zero)
+    {
+        std::copy(other._blocks, other._blocks+_nblocks, _blocks);
+    }
+
+    EpochBitset(EpochBitset &&other) noexcept:
+        _nbits(std::exchange(other._nbits, 0)), _nblocks(std::exchange(other._nblocks, 0)), _padblk(std::exchange(other._padblk, 0)),
+        _blocks(std::exchange(other._blocks, nullptr)), _epoch(std::exchange(other._epoch, 1)), _flag_zero(std::exchange(other._flag_zero, true))
+    {}
+
+    ~EpochBitset(){ delete [] _blocks; }
+
+    EpochBitset& operator=(EpochBitset other) noexcept // copy-and-swap, covers copy and move assignment
+    {
+        std::swap(_nbits, other._nbits);
+        std::swap(_nblocks, other._nblocks);
+        std::swap(_padblk, other._padblk);
+        std::swap(_blocks, other._blocks);
+        std::swap(_epoch, other._epoch);
+        std::swap(_flag_zero, other._flag_zero);
+        return *this;
+    }
+
+
+    // --- Overloaded Operators
+
+    EpochBitset& operator+=(const EpochBitset &other) { this->merge(other); return *this; }
+
+    friend bool operator==(const EpochBitset& lhs, const EpochBitset& rhs){ return lhs.equals(rhs); }
+    friend bool operator!=(const EpochBitset& lhs, const EpochBitset& rhs){ return !(lhs.equals(rhs)); }
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _nbits; }
+    SizeT getNBlocks() const { return _nblocks; }
+    AllocT getPadBlock() const { return _padblk; }
+    GenT getEpoch() const { return _epoch; }
+
+    AllocT getBlock(const SizeT blkidx) const { return (_blocks[blkidx].gen == _epoch) ? _blocks[blkidx].bits : alloct_zero; }
+
+
+    // --- Methods involving this bitfield
+
+    void reset() { // O(1), except on wrap-around of the epoch counter
+        if (_flag_zero) { return; }
+        if (++_epoch == 0) { // all stamps became ambiguous
+            _clearStamps();
+            _epoch = 1;
+        }
+        _flag_zero = true;
+    }
+
+    void set(SizeT index)
+    {   // pass 0<=index<_nbits
+        set(index / blocksize, index % blocksize);
+    }
+
+    void set(SizeT blockIndex, SizeT bitIndex)
+    {   // pass 0<=blkidx<_nblocks, 0<=bitidx<blocksize
+        Block &blk = _blocks[blockIndex];
+        if (blk.gen != _epoch) { // first write to this block in current epoch
+            blk.gen = _epoch;
+            blk.bits = alloct_zero;
+        }
+        blk.bits |= (alloct_one << static_cast<AllocT>(bitIndex));
+        _flag_zero = false;
+    }
+
+    void setAll() {
+        if (_nblocks == 0) { return; }
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { _blocks[blkidx] = Block{alloct_all, _epoch}; }
+        _blocks[_nblocks-1].bits = _padblk;
+        _flag_zero = false;
+    }
+
+    bool get(SizeT index) const
+    {   // pass 0<=index<_nbits
+        return ( (getBlock(index / blocksize) >> static_cast<AllocT>(index % blocksize)) & alloct_one );
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {
+        if (_flag_zero) return;
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            AllocT blkval = getBlock(blkidx);
+            while ( blkval ) {
+                callback( static_cast<SizeT>(blkidx*blocksize + blockkernels::ctz64(blkval)) );
+                blkval &= static_cast<AllocT>(blkval-alloct_one);
+            }
+        }
+    }
+
+    void getAll(bool out[] /*out[_nbits]*/) const
+    {
+        std::fill(out, out+_nbits, false);
+        forEachSet([out](const SizeT index) { out[index] = true; });
+    }
+
+    bool empty() const { return (_nbits == 0); }
+
+    bool any() const { return !_flag_zero; }
+
+    bool none() const { return _flag_zero; }
+
+    bool all() const
+    {
+        if (_flag_zero) { return false; }
+        for (SizeT blkidx=0; blkidx<_nblocks-1; ++blkidx) {
+            if (getBlock(blkidx) != alloct_all) { return false; }
+        }
+        return ( getBlock(_nblocks-1) == _padblk );
+    }
+
+    SizeT count() const
+    {
+        if (_flag_zero) { return 0; }
+        SizeT count = 0;
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { count += blockkernels::popcount64(getBlock(blkidx)); }
+        return count;
+    }
+
+
+    // Methods involving this and other bitfield
+
+    void merge(const EpochBitset &other) // set this = this | other
+    {
+        if (_nbits!=other._nbits || other._flag_zero) { return; }
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            const AllocT otherval = other.getBlock(blkidx);
+            if (otherval) { // untouched blocks stay stale
+                _blocks[blkidx] = Block{static_cast<AllocT>(getBlock(blkidx) | otherval), _epoch};
+            }
+        }
+        _flag_zero = false;
+    }
+
+    bool equals(const EpochBitset &other) const // return this == other
+    {
+        if (_nbits!=other._nbits) { return false; }
+        if (_flag_zero && other._flag_zero) { return true; }
+        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+            if (getBlock(blkidx) != other.getBlock(blkidx)) { return false; }
+        }
+        return true;
+    }
+
+private:
+    void _clearStamps() { std::fill(_blocks, _blocks+_nblocks, Block{alloct_zero, 0}); }
+};
+
+
+#endif
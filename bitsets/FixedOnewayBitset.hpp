@@ -0,0 +1,156 @@
+/* class FixedOnewayBitset
+   Author: Jan Kessler (2019)
+
+   Compile-time sized variant of OnewayBitset (see there for the concept).
+*/
+
+#ifndef FIXED_ONEWAY_BITSET_HPP
+#define FIXED_ONEWAY_BITSET_HPP
+
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+template <
+    size_t N, /* number of bits, fixed at compile time */
+    typename AllocT = uint64_t /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    >
+struct FixedOnewayBitset
+// The one-way bitset for sizes known at compile time, like std::bitset is for
+// std::vector<bool>. The blocks are stored inline (no allocation, 64 byte aligned),
+// and block count and padding mask are constants, so all loops have fixed trip
+// counts: for masks of a few hundred bits reset, any, merge, equals and count
+// compile down to a handful of (unrolled) vector instructions, and a bitset on the
+// stack can often be kept entirely in registers.
+// The interface is the one of OnewayBitset, with size_t indices. Unlike OnewayBitset
+// there is no any-flag, because testing a few blocks is as cheap as keeping it.
+{
+    // --- Static Asserts
+    static_assert(N > 0, "N must be positive.");
+    static_assert(std::is_integral<AllocT>::value && std::is_unsigned<AllocT>::value, "AllocT must be unsigned integral type.");
+
+    // --- Compile-Time Statics
+    static constexpr size_t blocksize = sizeof(AllocT)*CHAR_BIT;
+    static constexpr size_t nbits = N;
+    static constexpr size_t nblocks = (N + blocksize - 1)/blocksize;
+    static constexpr AllocT alloct_one = 1;
+    static constexpr AllocT alloct_zero = 0;
+    static constexpr AllocT alloct_all = ~(alloct_zero);
+    static constexpr AllocT padblk = (N%blocksize == 0) ? alloct_all : static_cast<AllocT>(~(alloct_all << (N%blocksize))); // all bits 1, except for the padded bits
+
+private:
+    alignas(64) AllocT _blocks[nblocks];
+
+public:
+    // --- Constructors
+
+    constexpr FixedOnewayBitset(): _blocks{} {} // all bits 0
+
+
+    // --- Overloaded Operators
+
+    FixedOnewayBitset& operator+=(const FixedOnewayBitset &other) { this->merge(other); return *this; }
+
+    friend FixedOnewayBitset operator+(FixedOnewayBitset lhs, const FixedOnewayBitset &rhs) { lhs.merge(rhs); return lhs; }
+
+    friend bool operator==(const FixedOnewayBitset& lhs, const FixedOnewayBitset& rhs){ return lhs.equals(rhs); }
+    friend bool operator!=(const FixedOnewayBitset& lhs, const FixedOnewayBitset& rhs){ return !(lhs.equals(rhs)); }
+
+
+    // --- Getters
+
+    static constexpr size_t getNBits() { return nbits; }
+    static constexpr size_t getNBlocks() { return nblocks; }
+    static constexpr AllocT getPadBlock() { return padblk; }
+    static constexpr size_t getNBytes() { return nblocks*sizeof(AllocT); }
+    const AllocT * getBlocks() const { return _blocks; }
+
+
+    // --- Methods involving this bitfield
+
+    void reset() { for (size_t i=0; i<nblocks; ++i) { _blocks[i] = alloct_zero; } }
+
+    void set(const size_t index) { _blocks[index/blocksize] |= static_cast<AllocT>(alloct_one << (index%blocksize)); } // pass 0<=index<N
+
+    void set(const size_t blockIndex, const size_t bitIndex) { _blocks[blockIndex] |= static_cast<AllocT>(alloct_one << bitIndex); }
+
+    void setAll()
+    {
+        for (size_t i=0; i<nblocks-1; ++i) { _blocks[i] = alloct_all; }
+        _blocks[nblocks-1] = padblk;
+    }
+
+    bool get(const size_t index) const { return (_blocks[index/blocksize] >> (index%blocksize)) & alloct_one; } // pass 0<=index<N
+
+    bool get(const size_t blockIndex, const size_t bitIndex) const { return (_blocks[blockIndex] >> bitIndex) & alloct_one; }
+
+    void getAll(bool out[] /*out[N]*/) const
+    {
+        std::fill(out, out+N, false);
+        forEachSet([out](const size_t index) { out[index] = true; });
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {
+        for (size_t i=0; i<nblocks; ++i) {
+            AllocT blkval = _blocks[i];
+            while ( blkval ) {
+                callback( i*blocksize + blockkernels::ctz64(blkval) );
+                blkval &= static_cast<AllocT>(blkval-alloct_one);
+            }
+        }
+    }
+
+    static constexpr bool empty() { return false; }
+
+    bool any() const
+    {
+        AllocT acc = alloct_zero;
+        for (size_t i=0; i<nblocks; ++i) { acc |= _blocks[i]; } // no early exit, to keep it branch-free
+        return acc != alloct_zero;
+    }
+
+    bool none() const { return !any(); }
+
+    bool all() const
+    {
+        AllocT acc = alloct_all;
+        for (size_t i=0; i<nblocks-1; ++i) { acc &= _blocks[i]; }
+        return acc == alloct_all && _blocks[nblocks-1] == padblk;
+    }
+
+    size_t count() const
+    {
+        size_t count = 0;
+        for (size_t i=0; i<nblocks; ++i) { count += blockkernels::popcount64(_blocks[i]); }
+        return count;
+    }
+
+
+    // Methods involving this and other bitfield
+
+    void merge(const FixedOnewayBitset &other) { for (size_t i=0; i<nblocks; ++i) { _blocks[i] |= other._blocks[i]; } }
+
+    bool equals(const FixedOnewayBitset &other) const
+    {
+        AllocT diff = alloct_zero;
+        for (size_t i=0; i<nblocks; ++i) { diff |= (_blocks[i] ^ other._blocks[i]); }
+        return diff == alloct_zero;
+    }
+};
+
+template <size_t N, typename AllocT> constexpr size_t FixedOnewayBitset<N, AllocT>::blocksize;
+template <size_t N, typename AllocT> constexpr size_t FixedOnewayBitset<N, AllocT>::nbits;
+template <size_t N, typename AllocT> constexpr size_t FixedOnewayBitset<N, AllocT>::nblocks;
+template <size_t N, typename AllocT> constexpr AllocT FixedOnewayBitset<N, AllocT>::alloct_one;
+template <size_t N, typename AllocT> constexpr AllocT FixedOnewayBitset<N, AllocT>::alloct_zero;
+template <size_t N, typename AllocT> constexpr AllocT FixedOnewayBitset<N, AllocT>::alloct_all;
+template <size_t N, typename AllocT> constexpr AllocT FixedOnewayBitset<N, AllocT>::padblk;
+
+
+#endif
@@ -0,0 +1,235 @@
+/* class MultiOnewayBitset
+   Author: Jan Kessler (2019)
+
+   K one-way bitsets of equal size in one bit-sliced allocation.
+*/
+
+#ifndef MULTI_ONEWAY_BITSET_HPP
+#define MULTI_ONEWAY_BITSET_HPP
+
+#include "OnewayBitset.hpp"
+#include "blockkernels.hpp"
+
+#include <type_traits>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+template <
+    typename SizeT, /* integral index type (e.g. int or size_t) */
+    typename AllocT /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    >
+struct MultiOnewayBitset
+// nmasks one-way bitsets of nbits each (e.g. one change mask per observable, over the
+// coordinates of a walker), stored transposed: row i holds bit k of every mask k, in
+// getRowBlocks() = ceil(nmasks/blocksize) blocks, and the rows are stored one after
+// another in one allocation. For a few hundred bits per mask this replaces nmasks
+// small heap allocations by one, and the common queries become row operations:
+// - which masks have bit i set (e.g. which observables need a recompute because
+//   coordinate i changed): one row, see forEachMaskAt() / anyAt()
+// - set bit i in all masks that depend on it: one row OR, see setMasksAt()
+// - merge all masks into one (which coordinates changed for any observable): one
+//   pass over the rows, see mergeMasks(), and merging two containers or resetting
+//   everything is a single block kernel call over the whole allocation.
+// Access to a single mask k (getMask(), countMask()) is strided instead, i.e. use this
+// container when the queries go by bit index rather than by mask.
+{
+    static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
+    static_assert(std::is_integral<AllocT>::value && std::is_unsigned<AllocT>::value, "AllocT must be unsigned integral type.");
+
+    static constexpr AllocT blocksize = static_cast<AllocT>( sizeof(AllocT)*CHAR_BIT );
+    static constexpr AllocT alloct_one = 1;
+    static constexpr AllocT alloct_zero = 0;
+    static constexpr AllocT alloct_all = ~(alloct_zero);
+
+private:
+    SizeT _nbits; // number of bits per mask
+    SizeT _nmasks; // number of masks
+    SizeT _rowblocks; // blocks per row
+    AllocT _padblk; // all bits 1, except for the padded bits of the last block of a row
+    std::vector<AllocT> _blocks; // _nbits rows of _rowblocks blocks
+    bool _flag_zero;
+
+public:
+    // --- Constructors
+
+    MultiOnewayBitset(const SizeT n_bits, const SizeT n_masks):
+        _nbits(n_bits > 0 ? n_bits : 0), _nmasks(n_masks > 0 ? n_masks : 0), _rowblocks(_nmasks > 0 ? (_nmasks-1)/blocksize + 1 : 0),
+        _padblk(_nmasks%blocksize == 0 ? alloct_all : static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(_nmasks%blocksize) ))),
+        _blocks(static_cast<size_t>(_nbits)*_rowblocks, alloct_zero), _flag_zero(true)
+    {}
+
+
+    // --- Overloaded Operators
+
+    MultiOnewayBitset& operator+=(const MultiOnewayBitset &other) { this->merge(other); return *this; }
+
+    friend bool operator==(const MultiOnewayBitset& lhs, const MultiOnewayBitset& rhs){ return lhs.equals(rhs); }
+    friend bool operator!=(const MultiOnewayBitset& lhs, const MultiOnewayBitset& rhs){ return !(lhs.equals(rhs)); }
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _nbits; }
+    SizeT getNMasks() const { return _nmasks; }
+    SizeT getRowBlocks() const { return _rowblocks; }
+    const AllocT * getRow(const SizeT index) const { return _blocks.data() + static_cast<size_t>(index)*_rowblocks; } // bit k = mask k
+
+
+    // --- Methods involving this container
+
+    void reset() // reset all masks, one fill
+    {
+        if (_flag_zero) { return; }
+        std::fill(_blocks.begin(), _blocks.end(), alloct_zero);
+        _flag_zero = true;
+    }
+
+    void set(const SizeT mask, const SizeT index) // set bit index of the given mask
+    {   // pass 0<=mask<_nmasks, 0<=index<_nbits
+        _row(index)[mask / blocksize] |= static_cast<AllocT>(alloct_one << static_cast<AllocT>(mask % blocksize));
+        _flag_zero = false;
+    }
+
+    void setMasksAt(const SizeT index, const AllocT masks[] /*masks[getRowBlocks()]*/) // set bit index of all masks k with bit k in masks
+    {   // pass 0<=index<_nbits, don't set bits >= _nmasks
+        AllocT * const row = _row(index);
+        for (SizeT b=0; b<_rowblocks; ++b) { row[b] |= masks[b]; }
+        _flag_zero = false;
+    }
+
+    void setAllMasksAt(const SizeT index) // set bit index of all masks
+    {   // pass 0<=index<_nbits
+        if (_rowblocks == 0) { return; }
+        AllocT * const row = _row(index);
+        std::fill(row, row+_rowblocks-1, alloct_all);
+        row[_rowblocks-1] = _padblk;
+        _flag_zero = false;
+    }
+
+    bool get(const SizeT mask, const SizeT index) const
+    {   // pass 0<=mask<_nmasks, 0<=index<_nbits
+        return ( (getRow(index)[mask / blocksize] >> static_cast<AllocT>(mask % blocksize)) & alloct_one );
+    }
+
+    bool anyAt(const SizeT index) const // is bit index set in any mask
+    {   // pass 0<=index<_nbits
+        const AllocT * const row = getRow(index);
+        return std::any_of(row, row+_rowblocks, [](const AllocT blk) { return blk != alloct_zero; });
+    }
+
+    template <typename Callback>
+    void forEachMaskAt(const SizeT index, Callback && callback) const // call callback(mask) for every mask with bit index set, ascending
+    {   // pass 0<=index<_nbits
+        const AllocT * const row = getRow(index);
+        for (SizeT b=0; b<_rowblocks; ++b) {
+            AllocT blkval = row[b];
+            while ( blkval ) {
+                callback( static_cast<SizeT>(b*blocksize + blockkernels::ctz64(blkval)) );
+                blkval &= static_cast<AllocT>(blkval-alloct_one);
+            }
+        }
+    }
+
+    template <typename Callback>
+    void forEachSet(const SizeT mask, Callback && callback) const // call callback(index) for every set bit of the given mask, ascending
+    {   // pass 0<=mask<_nmasks
+        if (_flag_zero) { return; }
+        const AllocT * blk = _blocks.data() + mask / blocksize;
+        const AllocT bit = static_cast<AllocT>(mask % blocksize);
+        for (SizeT index=0; index<_nbits; ++index, blk+=_rowblocks) {
+            if ((*blk >> bit) & alloct_one) { callback(index); }
+        }
+    }
+
+    bool any() const { return !_flag_zero && std::any_of(_blocks.begin(), _blocks.end(), [](const AllocT blk) { return blk != alloct_zero; }); }
+
+    bool none() const { return !any(); }
+
+    SizeT count() const // number of set bits in all masks
+    {
+        if (_flag_zero) { return 0; }
+        return static_cast<SizeT>( blockkernels::popcount(_bytes(), _nbytes()) );
+    }
+
+    SizeT countMask(const SizeT mask) const // number of set bits of the given mask
+    {   // pass 0<=mask<_nmasks
+        SizeT count = 0;
+        forEachSet(mask, [&count](const SizeT) { ++count; });
+        return count;
+    }
+
+    template <unsigned Opts, typename StorageT>
+    void getMask(const SizeT mask, OnewayBitset<SizeT, AllocT, Opts, StorageT> &out) const // out |= the given mask
+    {   // pass 0<=mask<_nmasks and out of size _nbits
+        if (_flag_zero || out.getNBits() != _nbits) { return; }
+        const AllocT * const blk = _blocks.data() + mask / blocksize;
+        const AllocT bit = static_cast<AllocT>(mask % blocksize);
+        _gatherRows(out, [blk, bit, this](const SizeT index) { return (blk[static_cast<size_t>(index)*_rowblocks] >> bit) & alloct_one; });
+    }
+
+    template <unsigned Opts, typename StorageT>
+    void mergeMasks(OnewayBitset<SizeT, AllocT, Opts, StorageT> &out) const // out |= mask 0 | mask 1 | ..., i.e. bit i = anyAt(i)
+    {   // pass out of size _nbits
+        if (_flag_zero || out.getNBits() != _nbits) { return; }
+        if (_rowblocks == 1) { // one block per row, a plain compare that the compiler vectorizes
+            const AllocT * const rows = _blocks.data();
+            _gatherRows(out, [rows](const SizeT index) { return static_cast<AllocT>(rows[index] != alloct_zero); });
+        }
+        else { _gatherRows(out, [this](const SizeT index) { return static_cast<AllocT>(anyAt(index)); }); }
+    }
+
+    void getNonEmptyMasks(AllocT out[] /*out[getRowBlocks()]*/) const // bit k of out = mask k has any bit set, i.e. OR of all rows
+    {
+        std::fill(out, out+_rowblocks, alloct_zero);
+        if (_flag_zero) { return; }
+        for (SizeT index=0; index<_nbits; ++index) {
+            const AllocT * const row = getRow(index);
+            for (SizeT b=0; b<_rowblocks; ++b) { out[b] |= row[b]; }
+        }
+    }
+
+
+    // Methods involving this and other container
+
+    void merge(const MultiOnewayBitset &other) // all masks: this |= other, one kernel call
+    {
+        if (_nbits!=other._nbits || _nmasks!=other._nmasks || other._flag_zero) { return; }
+        blockkernels::orInto(_bytes(), other._bytes(), _nbytes());
+        _flag_zero = false;
+    }
+
+    bool equals(const MultiOnewayBitset &other) const
+    {
+        if (_nbits!=other._nbits || _nmasks!=other._nmasks) { return false; }
+        if (_flag_zero && other._flag_zero) { return true; }
+        return blockkernels::equal(_bytes(), other._bytes(), _nbytes());
+    }
+
+private:
+    AllocT * _row(const SizeT index) { return _blocks.data() + static_cast<size_t>(index)*_rowblocks; }
+
+    unsigned char * _bytes() { return reinterpret_cast<unsigned char *>(_blocks.data()); }
+    const unsigned char * _bytes() const { return reinterpret_cast<const unsigned char *>(_blocks.data()); }
+    size_t _nbytes() const { return _blocks.size()*sizeof(AllocT); }
+
+    template <class BitsetT, typename RowBit>
+    void _gatherRows(BitsetT &out, RowBit && rowBit) const // out |= bits rowBit(index) (0 or 1), assembled block by block
+    {
+        for (SizeT blkidx=0; blkidx*static_cast<SizeT>(blocksize)<_nbits; ++blkidx) {
+            const SizeT first = blkidx*blocksize, n = std::min(static_cast<SizeT>(blocksize), static_cast<SizeT>(_nbits-first));
+            AllocT mask = alloct_zero;
+            for (SizeT j=0; j<n; ++j) { mask |= static_cast<AllocT>(rowBit(first+j) << j); }
+            out.setBlockMask(blkidx, mask);
+        }
+    }
+};
+
+template <typename SizeT, typename AllocT> constexpr AllocT MultiOnewayBitset<SizeT, AllocT>::blocksize;
+template <typename SizeT, typename AllocT> constexpr AllocT MultiOnewayBitset<SizeT, AllocT>::alloct_one;
+template <typename SizeT, typename AllocT> constexpr AllocT MultiOnewayBitset<SizeT, AllocT>::alloct_zero;
+template <typename SizeT, typename AllocT> constexpr AllocT MultiOnewayBitset<SizeT, AllocT>::alloct_all;
+
+
+#endif
@@ -10,15 +10,39 @@
 #ifndef ONEWAY_BITSET_HPP
 #define ONEWAY_BITSET_HPP
 
+#include "blockkernels.hpp"
+#include "ThreadPool.hpp"
+#include "storage.hpp"
+
 #include <type_traits>
 #include <limits>
 #include <climits>
+#include <cstddef>
+#include <cstdint>
 #include <algorithm>
+#include <utility>
+#include <iterator>
+#include <vector>
 #include <iostream>
+#include <stdexcept>
+
+// --- Compile-time options of OnewayBitset (combine via |)
+namespace onewayopt
+{
+    constexpr unsigned none = 0u;
+    constexpr unsigned summary = 1u << 0; // keep a summary bit per block, to let sparse bitsets skip untouched blocks
+    constexpr unsigned dirtylist = 1u << 1; // record blocks dirtied since reset, to make reset() proportional to changes
+    constexpr unsigned counting = 1u << 2; // keep an exact count of set bits, to make count() O(1)
+    constexpr unsigned streaming = 1u << 3; // prefetch in full scans and fill with non-temporal stores, for bitsets much larger than the caches
+}
+
+template <class BF, size_t N> struct OnewayOrExpr; // lazy a + b + ..., see below
 
 template <
     typename SizeT, /* integral index type (e.g. int or size_t) */
-    typename AllocT /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    typename AllocT, /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    unsigned Opts = onewayopt::none, /* compile-time options, see onewayopt */
+    typename StorageT = HeapStorage /* storage policy for the blocks, see storage.hpp */
     >
 struct OnewayBitset
 // A runtime-sized bitset class, specialized for the case that you never want
@@ -41,6 +65,69 @@ struct OnewayBitset
 // in my tests I get typically equal or slightly better performance, but the differences
 // vary with all relevant variables (system, compiler+options, chosen types, benchmark etc.)
 // in a somewhat unpredictable way. Anyway, I'm pleased with the results.
+// The bulk operations merge, equals, all and count work on whole 256/512 bit
+// vector lanes (see blockkernels.hpp), independent of the chosen AllocT.
+// Set bits can be visited directly via forEachSet() or setBits(), which skip
+// zero blocks and jump from set bit to set bit with count-trailing-zeros.
+// findFirst()/findNext() skip zero stretches 64 byte at a time (or via the summary),
+// rank()/select() map between positions and ordinals of set bits by popcounting
+// up to the position, or in O(1)/O(log n) with a sampled RankIndex.
+//
+// Options:
+// With onewayopt::summary, a second level of one bit per block is maintained by
+// set(), telling which blocks were touched since the last reset. Iteration, count
+// and reset then only visit touched blocks, i.e. their cost for sparse bitsets is
+// ~nblocks/64 summary words plus the touched blocks, instead of all blocks.
+// The price is one extra OR per set() and nblocks/8 bytes of memory.
+// With onewayopt::dirtylist, set() appends the index of every block that turns
+// non-zero to a list, so that reset() can zero exactly those blocks in time
+// proportional to the number of changes, independent of nbits. Once more than
+// nblocks/dirty_fraction blocks are dirty, recording stops and reset() falls
+// back to a full fill (which is then faster anyway).
+// With onewayopt::counting, set() increments a counter if the bit was 0 before (one
+// load it needs anyway, plus an add), so count() becomes O(1). Bulk setters count
+// per block, merge counts the result in the same pass (orIntoCount), only mergeAll
+// and expression assignments need an extra popcount pass over the result.
+// With onewayopt::streaming, the full scans of count, all, equals and getAll prefetch
+// ahead of the kernels (see blockkernels::streamPrefetchDistance), and full fills in
+// reset and setAll use non-temporal stores, so that clearing a multi-GB mask doesn't
+// evict the working set from the caches. Only worth it for bitsets far beyond the
+// last level cache: a bitset that is read right after the fill has to come from memory.
+//
+// Parallelism:
+// reset, count, merge and mergeAll have overloads that take a ThreadPool and split the
+// blocks into one contiguous chunk per worker (cache line aligned). Constructing with a pool
+// also zeroes the blocks through the pool, so on NUMA systems every chunk is placed
+// (first touch) on the node of the worker that processes it in all later calls.
+// These overloads work on all blocks, i.e. with summary/dirtylist options enabled they
+// just call the sequential versions, which are proportional to the touched blocks.
+//
+// Expressions:
+// a + b + c does not compute anything, it returns a lightweight OnewayOrExpr that
+// only points to its operands. Assigning it to a bitset (or constructing one from it)
+// evaluates the whole expression in one pass over all operands (see mergeAll), writing
+// every result block once and allocating nothing (unless the result is constructed or
+// its size changes). Don't store such expressions (auto e = a + b;) beyond the
+// lifetime of their operands, as usual for expression templates.
+//
+// Storage:
+// The blocks are allocated through the StorageT policy (see storage.hpp), by default
+// with new[]. AlignedStorage<> aligns them to cache lines, HugePageStorage puts large
+// bitsets on 2 MB pages (fewer TLB misses on random access). With MappedFileStorage they live in a memory-mapped file instead, e.g.
+//   OnewayBitset<size_t, uint64_t, onewayopt::none, MappedFileStorage> mask(nbits, MappedFileStorage("mask.bin"));
+// Reopening the file with the same nbits restores the bits (and the any-flag) without
+// reading the blocks, so pages are only loaded on access. Copies of such a bitset go to
+// anonymous memory. Note that the summary option has to rebuild its summary by a scan.
+// write()/read() store a bitset in a compact binary format (a 64 byte header plus the raw
+// blocks, see onewayformat), which ViewStorage can use in place, e.g. to load a checkpoint
+// with one mmap (no read, no copy).
+//
+// Memory:
+// Like std::vector, a bitset distinguishes its size from its capacity: assigning a
+// bitset of smaller or equal size (copy or expression) reuses the allocated blocks, so
+// a mask that is re-assigned in a loop allocates only once. shrink_to_fit() releases
+// the unused blocks (with MappedFileStorage the file keeps the capacity until then).
+// Moving and swapping bitsets never allocates.
 {
     // --- Static Asserts
     static_assert(std::is_integral<SizeT>::value, "SizeT must be integral type.");
@@ -52,55 +139,94 @@ struct OnewayBitset
     static constexpr AllocT alloct_one = 1; // block of alloc type, least bit 1
     static constexpr AllocT alloct_zero = 0; // block of alloc type, all bits 0
     static constexpr AllocT alloct_all = ~(alloct_zero); // block of alloc type, all bits 1
+    static constexpr bool has_summary = (Opts & onewayopt::summary) != 0;
+    static constexpr bool has_dirtylist = (Opts & onewayopt::dirtylist) != 0;
+    static constexpr bool has_counting = (Opts & onewayopt::counting) != 0;
+    static constexpr bool has_streaming = (Opts & onewayopt::streaming) != 0;
+    static constexpr int dirty_fraction = 16; // max fraction of dirty blocks to be recorded (1/dirty_fraction)
+    static constexpr size_t mergeall_batch = 16; // max sources streamed at once by mergeAll (prefetchers track only so many streams)
+    static constexpr SizeT npos = std::numeric_limits<SizeT>::max(); // "no such bit" of findFirst, findNext and select
+    static constexpr SizeT rank_sample_bits = 4096; // bits per sample of RankIndex (512 byte, a multiple of every blocksize)
 
 private:
     // these are const unless you use assignment operators
     SizeT _nbits; // number of bits (without padding)
     SizeT _nblocks; // number of memory blocks of sizeof(AllocT) byte
+    SizeT _capblocks; // number of allocated blocks (>= _nblocks, see shrink_to_fit)
     AllocT _padblk; // _padblk has all bits 1, except for the padded bits of the last block
 
     // variables
+    StorageT _storage; // provides the memory of _blocks
     AllocT * _blocks; // ptr to first block of the bitfield
+    uint64_t * _summary; // one bit per block, 1 if block was touched since reset (only with onewayopt::summary)
+    SizeT * _dirty; // indices of blocks dirtied since reset (only with onewayopt::dirtylist)
+    SizeT _ndirty; // number of recorded dirty blocks, or _dirtycap()+1 if overflown
+    SizeT _count; // number of set bits (only kept up-to-date with onewayopt::counting)
     bool _flag_zero;
 
 public:
     // --- Constructors/Destructor
 
     explicit OnewayBitset(const SizeT n_bits = 0): // we do sanity checks only here (to set proper empty state)
-        _nbits(n_bits > 0 ? n_bits : 0), _nblocks(_nbits > 0 ? (_nbits-1)/blocksize + 1 : 0),
-        _padblk(~( alloct_all << static_cast<AllocT>(_nbits%blocksize) )),
-        _blocks(_nbits > 0 ? new AllocT[_nblocks] : nullptr), _flag_zero(true)
+        OnewayBitset(n_bits, StorageT(), _NoInit{})
     {
-        reset();
+        _initFromStorage();
+    }
+
+    OnewayBitset(const SizeT n_bits, const StorageT &storage): // use given storage (e.g. to open a mapped file)
+        OnewayBitset(n_bits, storage, _NoInit{})
+    {
+        _initFromStorage();
+    }
+
+    OnewayBitset(const SizeT n_bits, ThreadPool &pool): // zero (first touch) the blocks in parallel
+        OnewayBitset(n_bits, StorageT(), _NoInit{})
+    {
+        _fillZero(pool);
     }
 
     OnewayBitset(const OnewayBitset &other):
-        _nbits(other._nbits), _nblocks(other._nblocks), _padblk(other._padblk),
-        _blocks(new AllocT[_nblocks]), _flag_zero(other._flag_zero)
+        _nbits(other._nbits), _nblocks(other._nblocks), _capblocks(other._nblocks), _padblk(other._padblk),
+        _storage(other._storage.selectOnCopy()), _blocks(_allocBlocks(_nblocks)),
+        _summary(has_summary ? new uint64_t[other._nsumwords()] : nullptr),
+        _dirty(has_dirtylist ? new SizeT[other._dirtycap()] : nullptr), _ndirty(other._ndirty), _count(other._count), _flag_zero(other._flag_zero)
     {
         std::copy(other._blocks, other._blocks+_nblocks, _blocks);
+        if (has_summary) { std::copy(other._summary, other._summary+_nsumwords(), _summary); }
+        if (has_dirtylist) { std::copy(other._dirty, other._dirty+std::min(_ndirty, _dirtycap()), _dirty); }
     }
 
-    ~OnewayBitset(){ delete [] _blocks; }
+    OnewayBitset(OnewayBitset &&other) noexcept: // leaves other empty
+        _nbits(std::exchange(other._nbits, 0)), _nblocks(std::exchange(other._nblocks, 0)), _capblocks(std::exchange(other._capblocks, 0)),
+        _padblk(std::exchange(other._padblk, 0)), _storage(std::move(other._storage)), _blocks(std::exchange(other._blocks, nullptr)),
+        _summary(std::exchange(other._summary, nullptr)), _dirty(std::exchange(other._dirty, nullptr)),
+        _ndirty(std::exchange(other._ndirty, 0)), _count(std::exchange(other._count, 0)), _flag_zero(std::exchange(other._flag_zero, true))
+    {}
+
+    template <size_t N>
+    OnewayBitset(const OnewayOrExpr<OnewayBitset, N> &expr): // evaluate expression (size of first operand)
+        OnewayBitset(expr.operands[0]->_nbits, expr.operands[0]->_storage.selectOnCopy(), _NoInit{})
+    {
+        if (has_summary || has_dirtylist) { _initFromStorage(); } // _assignOr needs valid metadata for these
+        else { _flag_zero = false; } // makes _assignOr overwrite the uninitialized blocks
+        _assignOr(expr.operands, N);
+    }
+
+    ~OnewayBitset(){ _freeBlocks(); delete [] _summary; delete [] _dirty; }
 
 
     // --- Canonical copy / move assignment
 
-    OnewayBitset& operator=(const OnewayBitset &other) // copy assignment
+    OnewayBitset& operator=(const OnewayBitset &other) // copy assignment (reuses our blocks if they are enough)
     {
         if (this != &other) { // self-assignment check
-            if (_nbits != other._nbits) { // we need to change constants
-                if (_nblocks != other._nblocks) { // we need to reallocate
-                    delete[] _blocks;
-                    _blocks = new AllocT[other._nblocks];
-                    _nblocks = other._nblocks;
-                }
-                // copy constants
-                _nbits = other._nbits;
-                _padblk = other._padblk;
-            }
+            if (_nbits != other._nbits) { _setSize(other._nbits); } // we need to change constants
             // copy data
             std::copy(other._blocks, other._blocks+_nblocks, _blocks);
+            if (has_summary) { std::copy(other._summary, other._summary+_nsumwords(), _summary); }
+            if (has_dirtylist) { std::copy(other._dirty, other._dirty+std::min(other._ndirty, _dirtycap()), _dirty); }
+            _ndirty = other._ndirty;
+            _count = other._count;
             _flag_zero = other._flag_zero;
         }
         return *this;
@@ -114,13 +240,39 @@ public:
             _nblocks = std::exchange(other._nblocks, 0);
             _padblk = std::exchange(other._padblk, 0);
 
-            delete[] _blocks;
+            _freeBlocks();
+            _capblocks = std::exchange(other._capblocks, 0);
+            _storage = std::move(other._storage);
             _blocks = std::exchange(other._blocks, nullptr);
+            delete[] _summary;
+            _summary = std::exchange(other._summary, nullptr);
+            delete[] _dirty;
+            _dirty = std::exchange(other._dirty, nullptr);
+            _ndirty = std::exchange(other._ndirty, 0);
+            _count = std::exchange(other._count, 0);
             _flag_zero = std::exchange(other._flag_zero, true);
         }
         return *this;
     }
 
+    void swap(OnewayBitset &other) noexcept
+    {
+        using std::swap;
+        swap(_nbits, other._nbits);
+        swap(_nblocks, other._nblocks);
+        swap(_capblocks, other._capblocks);
+        swap(_padblk, other._padblk);
+        swap(_storage, other._storage);
+        swap(_blocks, other._blocks);
+        swap(_summary, other._summary);
+        swap(_dirty, other._dirty);
+        swap(_ndirty, other._ndirty);
+        swap(_count, other._count);
+        swap(_flag_zero, other._flag_zero);
+    }
+
+    friend void swap(OnewayBitset &lhs, OnewayBitset &rhs) noexcept { lhs.swap(rhs); }
+
 
     // --- Overloaded Operators (using methods from below)
 
@@ -130,10 +282,30 @@ public:
         return *this;
     }
 
-    friend OnewayBitset operator+(OnewayBitset lhs, const OnewayBitset &rhs) // plus (merged copy)
+    template <size_t N>
+    OnewayBitset& operator+=(const OnewayOrExpr<OnewayBitset, N> &expr) // merge all operands in one pass
     {
-        lhs += rhs; // use merge on lhs copy
-        return lhs;
+        this->mergeAll(expr.operands, N);
+        return *this;
+    }
+
+    template <size_t N>
+    OnewayBitset& operator=(const OnewayOrExpr<OnewayBitset, N> &expr) // evaluate expression into this (which may be an operand)
+    {
+        const OnewayBitset &first = *expr.operands[0];
+        const bool resize = (_nbits != first._nbits);
+        if (resize) { // resize, then we have the state of a fresh allocation
+            _setSize(first._nbits);
+            if (has_summary || has_dirtylist) { _fillZero(); }
+            else { _flag_zero = false; } // makes _assignOr overwrite the blocks
+        }
+        _assignOr(expr.operands, N, !resize); // if resized, our old content is not an operand anymore
+        return *this;
+    }
+
+    friend OnewayOrExpr<OnewayBitset, 2> operator+(const OnewayBitset &lhs, const OnewayBitset &rhs) // plus (lazy merged copy)
+    {
+        return OnewayOrExpr<OnewayBitset, 2>{{&lhs, &rhs}};
     }
 
     friend bool operator==(const OnewayBitset& lhs, const OnewayBitset& rhs){ return lhs.equals(rhs); }
@@ -145,32 +317,160 @@ public:
     SizeT getNBlocks() const { return _nblocks; }
     AllocT getPadBlock() const { return _padblk; }
     const AllocT * const getBlocks() const { return _blocks; }
+    const uint64_t * getSummary() const { return _summary; } // nullptr unless onewayopt::summary
+    const StorageT & getStorage() const { return _storage; }
+    size_t getNBytes() const { return static_cast<size_t>(_nblocks)*sizeof(AllocT); }
+    SizeT capacity() const { return _capblocks*blocksize; } // bits that fit into the allocated blocks
 
 
     // --- Methods involving this bitfield
 
     void reset() { // reset to 0/false
-        std::fill(_blocks, _blocks+_nblocks, alloct_zero);
+        if (_flag_zero) { return; } // nothing was set since last reset
+        if (has_dirtylist && _ndirty <= _dirtycap()) { // zero only the recorded blocks
+            for (SizeT i=0; i<_ndirty; ++i) {
+                _blocks[_dirty[i]] = alloct_zero;
+                if (has_summary) { _summary[_dirty[i]/64] = 0; }
+            }
+        }
+        else if (has_summary) { // zero only the touched blocks
+            _forEachTouchedBlock([this](const SizeT blkidx) { _blocks[blkidx] = alloct_zero; });
+            std::fill(_summary, _summary+_nsumwords(), uint64_t(0));
+        }
+        else {
+            _fillBlocks(0, _nblocks, alloct_zero);
+        }
+        _ndirty = 0;
+        _count = 0;
         _flag_zero = true;
     }
 
+    void sync() { _storage.sync(_blocks, getNBytes()); } // flush blocks to backing store (if any)
+
+    void shrink_to_fit() { // release unused capacity (left over from assignments of smaller bitsets)
+        if (_capblocks == _nblocks) { return; }
+        if (storage_reuses_memory<StorageT>::value) { // the new allocation replaces the old one (e.g. mapped file), go through a copy
+            const std::vector<AllocT> tmp(_blocks, _blocks+_nblocks);
+            _freeBlocks();
+            _blocks = _allocBlocks(_nblocks);
+            std::copy(tmp.begin(), tmp.end(), _blocks);
+        }
+        else { // copy directly, i.e. at most old capacity plus new size at once
+            AllocT * const blocks = _allocBlocks(_nblocks);
+            std::copy(_blocks, _blocks+_nblocks, blocks);
+            _freeBlocks();
+            _blocks = blocks;
+        }
+        _capblocks = _nblocks;
+    }
+
+    void reset(ThreadPool &pool) { // parallel reset
+        if (has_summary || has_dirtylist) { reset(); return; }
+        if (_flag_zero) { return; }
+        _fillZero(pool);
+    }
+
     void set(SizeT index) // set the single bit via scalar index
     {   // pass 0<=index<_nbits
         const SizeT blockIndex = index / blocksize;
         const SizeT bitIndex = index % blocksize;
+        _touch(blockIndex);
+        if (has_counting) { _count += static_cast<SizeT>(~(_blocks[blockIndex] >> bitIndex) & alloct_one); } // +1 if bit was 0
         _blocks[blockIndex] |= (alloct_one << bitIndex);
         _flag_zero = false;
     }
 
     void set(SizeT blockIndex, SizeT bitIndex) // set the single bit via to tuple index
     {    // pass 0<=blkidx<_nblocks, 0<=bitidx<blocksize
+        _touch(blockIndex);
+        if (has_counting) { _count += static_cast<SizeT>(~(_blocks[blockIndex] >> static_cast<AllocT>(bitIndex)) & alloct_one); }
         _blocks[blockIndex] |= (alloct_one << static_cast<AllocT>(bitIndex));
         _flag_zero = false;
     }
 
     void setAll() { // fast way to set all bits 1
-        std::fill(_blocks, _blocks+_nblocks-1, alloct_all);
+        if (_nblocks == 0) { return; }
+        _fillBlocks(0, _nblocks-1, alloct_all);
         _blocks[_nblocks-1] = _padblk; // to make sure the padding bits are 0
+        if (has_summary) {
+            std::fill(_summary, _summary+_nsumwords(), ~uint64_t(0));
+            _summary[_nsumwords()-1] = _sumpadword();
+        }
+        _ndirty = _dirtycap()+1; // everything is dirty now
+        _count = _nbits;
+        _flag_zero = false;
+    }
+
+    void setRange(const SizeT first, const SizeT last) // set bits [first, last), block-wise
+    {   // pass 0<=first<=last<=_nbits
+        if (first >= last) { return; }
+        const SizeT firstblk = first / blocksize, lastblk = (last-1) / blocksize;
+        const AllocT firstmask = static_cast<AllocT>(alloct_all << (first % blocksize));
+        const AllocT lastmask = static_cast<AllocT>(alloct_all >> (blocksize-1 - (last-1) % blocksize));
+        if (firstblk == lastblk) { _orBlock(firstblk, static_cast<AllocT>(firstmask & lastmask)); }
+        else {
+            _orBlock(firstblk, firstmask);
+            if (has_counting) { // add the bits that were 0 before the fill
+                const size_t ninner = static_cast<size_t>(lastblk-firstblk-1)*sizeof(AllocT);
+                _count += static_cast<SizeT>(ninner*8 - blockkernels::popcount(_bytes()+(firstblk+1)*sizeof(AllocT), ninner));
+            }
+            for (SizeT blkidx=firstblk+1; blkidx<lastblk; ++blkidx) { // plain fill without options
+                _touch(blkidx);
+                _blocks[blkidx] = alloct_all;
+            }
+            _orBlock(lastblk, lastmask);
+        }
+        _flag_zero = false;
+    }
+
+    void setStrided(const SizeT first, const SizeT step) // set bits first, first+step, first+2*step, ... < _nbits
+    {   // pass 0<=first<_nbits, step>0
+        if (step == 1) { setRange(first, _nbits); return; }
+        if (step >= static_cast<SizeT>(blocksize)) { // at most one bit per block anyway
+            for (SizeT index=first; index<_nbits; index+=step) { set(index); }
+            return;
+        }
+        // the bits of a block are given by the offset of its first bit, which is < step (except in the first block)
+        AllocT masks[blocksize];
+        for (SizeT offset=0; offset<step; ++offset) {
+            masks[offset] = alloct_zero;
+            for (SizeT bit=offset; bit<static_cast<SizeT>(blocksize); bit+=step) { masks[offset] |= static_cast<AllocT>(alloct_one << bit); }
+        }
+        const SizeT shift = step - blocksize % step; // offset(blk+1) = (offset(blk) + shift) % step
+        SizeT offset = first % blocksize;
+        const AllocT firstmask = static_cast<AllocT>(masks[offset % step] & (alloct_all << offset));
+        _orBlock(first / blocksize, (static_cast<SizeT>(first / blocksize) == _nblocks-1) ? static_cast<AllocT>(firstmask & _padblk) : firstmask);
+        offset = (offset % step + shift) % step;
+        for (SizeT blkidx=first/blocksize+1; blkidx<_nblocks; ++blkidx) {
+            _orBlock(blkidx, (blkidx == _nblocks-1) ? static_cast<AllocT>(masks[offset] & _padblk) : masks[offset]);
+            offset = (offset + shift) % step;
+        }
+        _flag_zero = false;
+    }
+
+    template <typename InputIt>
+    void setIndices(InputIt begin, InputIt end) // set all bits of a batch of indices, one write per run of indices in the same block
+    {   // pass 0<=index<_nbits, sorted batches need the fewest writes
+        if (begin == end) { return; }
+        SizeT blkidx = static_cast<SizeT>(*begin) / blocksize;
+        AllocT mask = alloct_zero;
+        for (; begin != end; ++begin) {
+            const SizeT index = static_cast<SizeT>(*begin);
+            if (static_cast<SizeT>(index / blocksize) != blkidx) {
+                _orBlock(blkidx, mask);
+                blkidx = index / blocksize;
+                mask = alloct_zero;
+            }
+            mask |= static_cast<AllocT>(alloct_one << (index % blocksize));
+        }
+        _orBlock(blkidx, mask);
+        _flag_zero = false;
+    }
+
+    void setBlockMask(const SizeT blockIndex, const AllocT mask) // set the bits of mask in the given block, i.e. block |= mask
+    {   // pass 0<=blockIndex<_nblocks, don't set padding bits in the last block
+        if (mask == alloct_zero) { return; }
+        _orBlock(blockIndex, mask);
         _flag_zero = false;
     }
 
@@ -188,21 +488,102 @@ public:
 
     void getAll(bool out[] /*out[_nbits]*/) const // get all, to fill an ordinary bool array
     {
-        std::fill(out, out+_nbits, false); // this should be fast and usually worth it ..
-        if (_flag_zero) return;
+        if (_flag_zero) { std::fill(out, out+_nbits, false); return; }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        static_assert(sizeof(bool) == 1, "bool must be one byte for the vectorized expansion.");
+        const SizeT nfull = _nbits/8; // expand whole bytes of blocks to 8 bools each, at memory speed
+        if (has_streaming) { blockkernels::expandBitsStream(_bytes(), reinterpret_cast<unsigned char *>(out), static_cast<size_t>(nfull)); }
+        else { blockkernels::expandBits(_bytes(), reinterpret_cast<unsigned char *>(out), static_cast<size_t>(nfull)); }
+        for (SizeT i=nfull*8; i<_nbits; ++i) { out[i] = get(i); }
+#else
+        std::fill(out, out+_nbits, false);
+        forEachSet([out](const SizeT index) { out[index] = true; });
+#endif
+    }
 
-        SizeT blkoff = 0;
-        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx, blkoff+=blocksize) {
+    SizeT getIndices(SizeT out[] /*out[count()]*/) const // get indices of all set bits (ascending), returns their number
+    {
+        SizeT n = 0;
+        forEachSet([out, &n](const SizeT index) { out[n++] = index; });
+        return n;
+    }
+
+    template <typename Callback>
+    void forEachSet(Callback && callback) const // call callback(index) for every set bit, in ascending order
+    {
+        if (_flag_zero) return;
+        _forEachTouchedBlock([this, &callback](const SizeT blkidx) {
+            const SizeT blkoff = blkidx*blocksize;
             AllocT blkval = _blocks[blkidx];
-            SizeT bitidx = blkoff;
-            while ( blkval ) { // .. because then we can stop early here
-                out[bitidx] = blkval & alloct_one;
-                blkval >>= alloct_one;
-                ++bitidx;
+            while ( blkval ) {
+                callback( static_cast<SizeT>(blkoff + blockkernels::ctz64(blkval)) );
+                blkval &= static_cast<AllocT>(blkval-alloct_one); // clear lowest set bit
             }
-        }
+        });
     }
 
+    class SetBitIterator // forward iterator over the indices of set bits
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = SizeT;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const SizeT *;
+        using reference = SizeT;
+
+        SetBitIterator(const AllocT * blocks, const uint64_t * summary, const SizeT nblocks, const SizeT blkidx):
+            _blocks(blocks), _summary(summary), _nblocks(nblocks), _blkidx(blkidx), _blkval(blkidx < nblocks ? blocks[blkidx] : alloct_zero)
+        {
+            _skipZeroBlocks();
+        }
+
+        SizeT operator*() const { return static_cast<SizeT>(_blkidx*blocksize + blockkernels::ctz64(_blkval)); }
+
+        SetBitIterator& operator++()
+        {
+            _blkval &= static_cast<AllocT>(_blkval-alloct_one);
+            _skipZeroBlocks();
+            return *this;
+        }
+
+        SetBitIterator operator++(int) { SetBitIterator tmp(*this); ++(*this); return tmp; }
+
+        friend bool operator==(const SetBitIterator &lhs, const SetBitIterator &rhs) { return (lhs._blkidx == rhs._blkidx && lhs._blkval == rhs._blkval); }
+        friend bool operator!=(const SetBitIterator &lhs, const SetBitIterator &rhs) { return !(lhs == rhs); }
+
+    private:
+        const AllocT * _blocks;
+        const uint64_t * _summary; // nullptr unless onewayopt::summary
+        SizeT _nblocks;
+        SizeT _blkidx;
+        AllocT _blkval; // remaining (not yet visited) bits of current block
+
+        void _skipZeroBlocks()
+        {
+            while ( !_blkval && _blkidx < _nblocks ) {
+                ++_blkidx;
+                if (has_summary) { // jump over runs of untouched blocks
+                    while ( _blkidx < _nblocks && (_summary[_blkidx/64] >> (_blkidx%64)) == 0 ) {
+                        _blkidx = (_blkidx/64 + 1)*64;
+                    }
+                    if (_blkidx > _nblocks) { _blkidx = _nblocks; }
+                }
+                _blkval = (_blkidx < _nblocks) ? _blocks[_blkidx] : alloct_zero;
+            }
+        }
+    };
+
+    struct SetBitRange // to be used in range-based for loops
+    {
+        SetBitIterator first, last;
+        SetBitIterator begin() const { return first; }
+        SetBitIterator end() const { return last; }
+    };
+
+    SetBitIterator beginSet() const { return SetBitIterator(_blocks, _summary, _nblocks, _flag_zero ? _nblocks : 0); }
+    SetBitIterator endSet() const { return SetBitIterator(_blocks, _summary, _nblocks, _nblocks); }
+    SetBitRange setBits() const { return SetBitRange{beginSet(), endSet()}; }
+
     bool empty() const { return (_nbits == 0); }
 
     bool any() const { return !_flag_zero; }
@@ -212,46 +593,564 @@ public:
     bool all() const
     {
         if (_flag_zero) { return false; }
-        SizeT blkidx;
-        for (blkidx=0; blkidx<_nblocks-1; ++blkidx) {
-            if (_blocks[blkidx] != alloct_all) {
-                return false;
-            }
-        }
-        return ( _blocks[blkidx] == _padblk );
+        const SizeT lastidx = _nblocks-1;
+        const size_t nbytes = static_cast<size_t>(lastidx)*sizeof(AllocT);
+        return ( (has_streaming ? blockkernels::allOnesStream(_bytes(), nbytes) : blockkernels::allOnes(_bytes(), nbytes)) && _blocks[lastidx] == _padblk );
     }
 
-    SizeT count() const // returns number of true bits in worst-case log(N) time
+    SizeT count() const // returns number of true bits (vectorized popcount, linear in nblocks)
     {
+        if (has_counting) { return _count; }
         if (_flag_zero) { return 0; }
-        SizeT count = 0;
-        for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
-            AllocT blkval = _blocks[blkidx];
-            while( blkval ) {
-                blkval = blkval & (blkval-alloct_one);
-                ++count;
+        return _countTouched();
+    }
+
+    SizeT count(ThreadPool &pool) const // parallel count, as reduction over per-worker counts
+    {
+        if (has_summary || has_dirtylist || has_counting) { return count(); }
+        if (_flag_zero) { return 0; }
+        std::vector<uint64_t> partial(8*pool.size(), 0); // one cache line per worker
+        pool.run([this, &pool, &partial](const int t) {
+            SizeT first, last;
+            _chunk(t, pool.size(), first, last);
+            partial[8*t] = blockkernels::popcount(_bytes()+first*sizeof(AllocT), static_cast<size_t>(last-first)*sizeof(AllocT));
+        });
+        uint64_t count = 0;
+        for (int t=0; t<pool.size(); ++t) { count += partial[8*t]; }
+        return static_cast<SizeT>(count);
+    }
+
+    // --- Search, rank and select
+
+    SizeT findFirst() const { return _findFrom(0); } // index of the first set bit, or npos
+
+    SizeT findNext(const SizeT pos) const { return (pos+1 < _nbits) ? _findFrom(pos+1) : npos; } // first set bit after pos, or npos
+
+    SizeT rank(const SizeT pos) const // number of set bits before pos (pass 0<=pos<=_nbits), popcounts all blocks before pos
+    {
+        if (_flag_zero) { return 0; }
+        return _rankFrom(0, 0, pos);
+    }
+
+    SizeT select(const SizeT k) const // index of the set bit of rank k (counting from 0), or npos, popcounts all blocks up to it
+    {
+        if (_flag_zero) { return npos; }
+        return _selectFrom(0, k);
+    }
+
+    struct RankIndex
+    // Sampled popcount index for rank/select: the number of set bits before every rank_sample_bits-th
+    // bit, i.e. one SizeT per 512 byte of blocks. With it rank() is O(1) (lookup + popcount of at most
+    // 512 byte) and select() O(log n) (binary search over the samples + scan of at most 512 byte).
+    // The index reflects the bitset at construction or update(), i.e. like an iterator it becomes
+    // stale when the bitset is modified (it keeps a pointer to the bitset, too).
+    {
+        explicit RankIndex(const OnewayBitset &bitset): _bitset(&bitset) { update(); }
+
+        void update() // rebuild after modifications of the bitset
+        {
+            const SizeT nsamples = (_bitset->_nblocks + _sampleblks - 1)/_sampleblks;
+            _samples.assign(static_cast<size_t>(nsamples)+1, 0);
+            if (_bitset->_flag_zero) { return; }
+            for (SizeT s=0; s<nsamples; ++s) {
+                const SizeT first = s*_sampleblks, last = std::min(first+_sampleblks, _bitset->_nblocks);
+                _samples[s+1] = _samples[s] + static_cast<SizeT>(blockkernels::popcount(_bitset->_bytes()+first*sizeof(AllocT), static_cast<size_t>(last-first)*sizeof(AllocT)));
             }
         }
-        return count;
-    }
+
+        SizeT count() const { return _samples.back(); }
+
+        SizeT rank(const SizeT pos) const // like OnewayBitset::rank
+        {
+            const SizeT s = pos/rank_sample_bits;
+            if (static_cast<size_t>(s)+1 >= _samples.size()) { return count(); } // pos == nbits, at a sample border
+            return _bitset->_rankFrom(s*_sampleblks, _samples[s], pos);
+        }
+
+        SizeT select(const SizeT k) const // like OnewayBitset::select
+        {
+            if (k >= count()) { return npos; }
+            const SizeT s = static_cast<SizeT>(std::upper_bound(_samples.begin(), _samples.end(), k) - _samples.begin()) - 1; // last sample <= k
+            return _bitset->_selectFrom(s*_sampleblks, k - _samples[s]);
+        }
+
+    private:
+        static constexpr SizeT _sampleblks = rank_sample_bits/blocksize;
+        const OnewayBitset * _bitset;
+        std::vector<SizeT> _samples; // set bits before sample s, count() at the end
+    };
+
 
     // Methods involving this and other bitfield
 
     void merge(const OnewayBitset &other) // set this = this | other
     {
         if (_nbits!=other._nbits) { return; }
-        for (SizeT i=0; i<_nblocks; ++i) {
-            _blocks[i] |= other._blocks[i];
+        if (!other._flag_zero) { // nothing to do otherwise
+            if (has_dirtylist && other._ndirty <= other._dirtycap()) { // other is sparse, so OR only its dirty blocks
+                for (SizeT i=0; i<other._ndirty; ++i) {
+                    const SizeT blkidx = other._dirty[i];
+                    _orBlock(blkidx, other._blocks[blkidx]);
+                }
+            }
+            else if (has_summary) { // OR only blocks touched in other, full summary words via the dense kernel
+                for (SizeT w=0; w<_nsumwords(); ++w) {
+                    const uint64_t sumword = other._summary[w];
+                    if (sumword == ~uint64_t(0)) {
+                        blockkernels::orInto(_bytes()+w*64*sizeof(AllocT), other._bytes()+w*64*sizeof(AllocT), 64*sizeof(AllocT));
+                    }
+                    else {
+                        _forEachBit(sumword, [this, &other, w](const unsigned bit) { _blocks[w*64+bit] |= other._blocks[w*64+bit]; });
+                    }
+                    _summary[w] |= sumword;
+                }
+                if (has_counting) { _count = _countTouched(); }
+            }
+            else if (has_counting) { _count = static_cast<SizeT>(blockkernels::orIntoCount(_bytes(), other._bytes(), getNBytes())); }
+            else {
+                blockkernels::orInto(_bytes(), other._bytes(), getNBytes());
+            }
+            if (has_dirtylist && other._ndirty > other._dirtycap()) { _ndirty = _dirtycap()+1; } // we didn't record
         }
         _flag_zero = (_flag_zero && other._flag_zero);
     }
 
+    void mergeAll(const OnewayBitset * const * others, const size_t nothers) // set this = this | *others[0] | *others[1] | ...
+    {   // streams all sources at once, so every block of this is loaded and stored once per batch of sources
+        if (has_summary || has_dirtylist) { // their merge() is proportional to the touched blocks of each source
+            for (size_t i=0; i<nothers; ++i) { merge(*others[i]); }
+            return;
+        }
+        std::vector<const unsigned char *> srcs;
+        srcs.reserve(nothers);
+        for (size_t i=0; i<nothers; ++i) {
+            if (others[i]->_nbits == _nbits && !others[i]->_flag_zero) { srcs.push_back(others[i]->_bytes()); }
+        }
+        for (size_t i=0; i<srcs.size(); i+=mergeall_batch) {
+            blockkernels::orManyInto(_bytes(), srcs.data()+i, std::min(mergeall_batch, srcs.size()-i), getNBytes());
+        }
+        if (has_counting && !srcs.empty()) { _count = _countTouched(); }
+        _flag_zero = (_flag_zero && srcs.empty());
+    }
+
+    void merge(const OnewayBitset &other, ThreadPool &pool) // parallel merge
+    {
+        if (has_summary || has_dirtylist) { merge(other); return; }
+        if (_nbits!=other._nbits) { return; }
+        if (!other._flag_zero) {
+            std::vector<uint64_t> partial(has_counting ? 8*pool.size() : 0, 0); // one cache line per worker
+            pool.run([this, &other, &pool, &partial](const int t) {
+                SizeT first, last;
+                _chunk(t, pool.size(), first, last);
+                unsigned char * const dst = _bytes()+first*sizeof(AllocT);
+                const unsigned char * const src = other._bytes()+first*sizeof(AllocT);
+                if (has_counting) { partial[8*t] = blockkernels::orIntoCount(dst, src, static_cast<size_t>(last-first)*sizeof(AllocT)); }
+                else { blockkernels::orInto(dst, src, static_cast<size_t>(last-first)*sizeof(AllocT)); }
+            });
+            if (has_counting) {
+                _count = 0;
+                for (int t=0; t<pool.size(); ++t) { _count += static_cast<SizeT>(partial[8*t]); }
+            }
+        }
+        _flag_zero = (_flag_zero && other._flag_zero);
+    }
+
+    void mergeAll(const OnewayBitset * const * others, const size_t nothers, ThreadPool &pool) // parallel mergeAll
+    {   // every worker streams its chunk of all sources (in batches, like the sequential version)
+        if (has_summary || has_dirtylist) { mergeAll(others, nothers); return; }
+        std::vector<const unsigned char *> srcs;
+        srcs.reserve(nothers);
+        for (size_t i=0; i<nothers; ++i) {
+            if (others[i]->_nbits == _nbits && !others[i]->_flag_zero) { srcs.push_back(others[i]->_bytes()); }
+        }
+        if (srcs.empty()) { return; }
+        std::vector<const unsigned char *> chunksrcs(srcs.size()*pool.size()); // source pointers, offset to the chunk of each worker
+        std::vector<uint64_t> partial(has_counting ? 8*pool.size() : 0, 0); // one cache line per worker
+        pool.run([this, &srcs, &chunksrcs, &pool, &partial](const int t) {
+            SizeT first, last;
+            _chunk(t, pool.size(), first, last);
+            const size_t offset = static_cast<size_t>(first)*sizeof(AllocT), nbytes = static_cast<size_t>(last-first)*sizeof(AllocT);
+            const unsigned char ** const mysrcs = chunksrcs.data() + t*srcs.size();
+            for (size_t i=0; i<srcs.size(); ++i) { mysrcs[i] = srcs[i] + offset; }
+            for (size_t i=0; i<srcs.size(); i+=mergeall_batch) {
+                blockkernels::orManyInto(_bytes()+offset, mysrcs+i, std::min(mergeall_batch, srcs.size()-i), nbytes);
+            }
+            if (has_counting) { partial[8*t] = blockkernels::popcount(_bytes()+offset, nbytes); }
+        });
+        if (has_counting) {
+            _count = 0;
+            for (int t=0; t<pool.size(); ++t) { _count += static_cast<SizeT>(partial[8*t]); }
+        }
+        _flag_zero = false;
+    }
+
+    // fused queries (operation and reduction in one pass, no temporary bitset), pass bitsets of equal size
+
+    bool intersects(const OnewayBitset &other) const // (this & other) != 0
+    {
+        if (_nbits!=other._nbits || _flag_zero || other._flag_zero) { return false; }
+        return blockkernels::anyAnd(_bytes(), other._bytes(), getNBytes());
+    }
+
+    bool isSubsetOf(const OnewayBitset &other) const // (this & ~other) == 0
+    {
+        if (_nbits!=other._nbits) { return false; }
+        if (_flag_zero) { return true; }
+        if (other._flag_zero) { return false; }
+        return !blockkernels::anyAndNot(_bytes(), other._bytes(), getNBytes());
+    }
+
+    SizeT countUnion(const OnewayBitset &other) const // count(this | other)
+    {
+        if (_nbits!=other._nbits) { return 0; }
+        if (_flag_zero) { return other.count(); }
+        if (other._flag_zero) { return count(); }
+        return static_cast<SizeT>( blockkernels::popcountOr(_bytes(), other._bytes(), getNBytes()) );
+    }
+
+    SizeT countIntersection(const OnewayBitset &other) const // count(this & other)
+    {
+        if (_nbits!=other._nbits || _flag_zero || other._flag_zero) { return 0; }
+        return static_cast<SizeT>( blockkernels::popcountAnd(_bytes(), other._bytes(), getNBytes()) );
+    }
+
+    SizeT countAndNot(const OnewayBitset &other) const // count(this & ~other)
+    {
+        if (_nbits!=other._nbits || _flag_zero) { return 0; }
+        if (other._flag_zero) { return count(); }
+        return static_cast<SizeT>( blockkernels::popcountAndNot(_bytes(), other._bytes(), getNBytes()) );
+    }
+
     bool equals(const OnewayBitset &other) const // return this == other
     {
         if (_nbits!=other._nbits) { return false; }
-        return std::equal(_blocks, _blocks+_nblocks, other._blocks);
+        if (_flag_zero && other._flag_zero) { return true; }
+        if (has_streaming) { return blockkernels::equalStream(_bytes(), other._bytes(), getNBytes()); }
+        return blockkernels::equal(_bytes(), other._bytes(), getNBytes());
+    }
+
+
+    // --- Serialization (see onewayformat in storage.hpp)
+
+    void write(std::ostream &os) const // header and blocks, written straight from memory
+    {
+        const onewayformat::Header header = onewayformat::makeHeader(static_cast<uint64_t>(_nbits), sizeof(AllocT), getNBytes(), !_flag_zero);
+        os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (_nblocks > 0) { os.write(reinterpret_cast<const char *>(_blocks), static_cast<std::streamsize>(getNBytes())); }
+        if (!os) { throw std::runtime_error("OnewayBitset: write failed"); }
+    }
+
+    void read(std::istream &is) // replace this by a bitset from write(), read straight into the blocks (resizes, see capacity)
+    {   // A different AllocT of the writer is fine on little-endian machines (the byte layout is the same for all)
+        onewayformat::Header header;
+        if (!is.read(reinterpret_cast<char *>(&header), sizeof(header))) { throw std::runtime_error("OnewayBitset: read failed"); }
+        header = onewayformat::checkHeader(header);
+        if (header.blockbytes != sizeof(AllocT) && (header.endian != onewayformat::little_endian || onewayformat::native_endian != onewayformat::little_endian)) {
+            throw std::runtime_error("OnewayBitset: cannot convert blocks of different size and byte order");
+        }
+        if (header.nbits > static_cast<uint64_t>(std::numeric_limits<SizeT>::max())) { throw std::runtime_error("OnewayBitset: too many bits for SizeT"); }
+
+        _setSize(static_cast<SizeT>(header.nbits));
+        const size_t nread = static_cast<size_t>(std::min<uint64_t>(header.nbytes, getNBytes()));
+        if (nread > 0 && !is.read(reinterpret_cast<char *>(_blocks), static_cast<std::streamsize>(nread))) { throw std::runtime_error("OnewayBitset: read failed"); }
+        std::fill(_bytes()+nread, _bytes()+getNBytes(), static_cast<unsigned char>(0)); // our blocks are larger than the writer's
+        if (header.nbytes > nread) { is.ignore(static_cast<std::streamsize>(header.nbytes - nread)); } // or smaller (padding only)
+        if (header.endian != onewayformat::native_endian) {
+            for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { _blocks[blkidx] = onewayformat::byteswap(_blocks[blkidx]); }
+        }
+        if (_nblocks > 0) { _blocks[_nblocks-1] &= _padblk; } // don't trust the padding bits
+        _initFromState(header.nonzero ? StorageState::nonzero : StorageState::zero);
+    }
+
+private:
+    // --- Internal helpers
+
+    struct _NoInit {}; // tag for the allocating, but not initializing constructor
+
+    OnewayBitset(const SizeT n_bits, const StorageT &storage, _NoInit):
+        _nbits(n_bits > 0 ? n_bits : 0), _nblocks(_nbits > 0 ? (_nbits-1)/blocksize + 1 : 0), _capblocks(_nblocks),
+        _padblk(_nbits%blocksize == 0 ? alloct_all : static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(_nbits%blocksize) ))),
+        _storage(storage), _blocks(_allocBlocks(_nblocks)),
+        _summary(has_summary && _nbits > 0 ? new uint64_t[_nsumwords()] : nullptr),
+        _dirty(has_dirtylist ? new SizeT[_dirtycap()] : nullptr), _ndirty(0), _count(0), _flag_zero(true)
+    {}
+
+    void _setSize(const SizeT n_bits) { // change size and constants, contents are undefined afterwards
+        const SizeT nblocks = (n_bits > 0) ? (n_bits-1)/blocksize + 1 : 0;
+        if (nblocks > _capblocks) { // we need to reallocate
+            _freeBlocks();
+            _blocks = _allocBlocks(nblocks);
+            _capblocks = nblocks;
+        }
+        if (nblocks != _nblocks) { // summary and dirty list are small, so we don't keep capacity for them
+            if (has_summary) {
+                delete[] _summary;
+                _summary = new uint64_t[(nblocks+63)/64];
+            }
+            if (has_dirtylist) {
+                delete[] _dirty;
+                _dirty = new SizeT[nblocks/dirty_fraction + 1];
+            }
+        }
+        _nbits = n_bits;
+        _nblocks = nblocks;
+        _padblk = (_nbits%blocksize == 0) ? alloct_all : static_cast<AllocT>(~( alloct_all << static_cast<AllocT>(_nbits%blocksize) ));
+    }
+
+    AllocT * _allocBlocks(const SizeT nblocks) { return (nblocks > 0) ? _storage.template allocate<AllocT>(static_cast<size_t>(nblocks)) : nullptr; }
+
+    void _freeBlocks() {
+        if (_blocks) {
+            _storage.storeState(!_flag_zero);
+            _storage.template deallocate<AllocT>(_blocks, static_cast<size_t>(_capblocks));
+            _blocks = nullptr;
+        }
+    }
+
+    void _initFromStorage() { _initFromState(_blocks ? _storage.restoredState() : StorageState::zero); }
+
+    void _initFromState(const StorageState state) { // set flag and metadata according to the state of the blocks
+        switch (state) {
+        case StorageState::fresh:
+            _fillZero();
+            return;
+        case StorageState::zero:
+            _flag_zero = true;
+            break;
+        case StorageState::nonzero:
+            _flag_zero = false;
+            break;
+        case StorageState::unknown:
+            _flag_zero = (blockkernels::popcount(_bytes(), getNBytes()) == 0);
+            break;
+        }
+        if (has_summary) {
+            std::fill(_summary, _summary+_nsumwords(), uint64_t(0));
+            if (!_flag_zero) { // we have to scan for the touched blocks
+                for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) {
+                    if (_blocks[blkidx]) { _summary[blkidx/64] |= uint64_t(1) << (blkidx%64); }
+                }
+            }
+        }
+        _ndirty = _flag_zero ? 0 : _dirtycap()+1; // unknown dirty blocks
+        _count = _flag_zero ? 0 : _countTouched();
+    }
+
+    void _chunk(const int t, const int nchunks, SizeT &first, SizeT &last) const // block range of chunk t
+    {   // chunk borders are aligned to 64 byte, to avoid false sharing between workers
+        const SizeT align = static_cast<SizeT>(64/sizeof(AllocT));
+        const SizeT nunits = (_nblocks + align - 1) / align;
+        first = std::min(_nblocks, static_cast<SizeT>(static_cast<uint64_t>(nunits)*t/nchunks*align));
+        last = std::min(_nblocks, static_cast<SizeT>(static_cast<uint64_t>(nunits)*(t+1)/nchunks*align));
+    }
+
+    void _fillZero(ThreadPool &pool) { // zero all blocks in parallel chunks (and summary)
+        pool.run([this, &pool](const int t) {
+            SizeT first, last;
+            _chunk(t, pool.size(), first, last);
+            _fillBlocks(first, last, alloct_zero);
+        });
+        if (has_summary) { std::fill(_summary, _summary+_nsumwords(), uint64_t(0)); }
+        _ndirty = 0;
+        _count = 0;
+        _flag_zero = true;
+    }
+
+    unsigned char * _bytes() { return reinterpret_cast<unsigned char *>(_blocks); }
+    const unsigned char * _bytes() const { return reinterpret_cast<const unsigned char *>(_blocks); }
+
+    SizeT _nsumwords() const { return (_nblocks+63)/64; } // number of summary words
+    uint64_t _sumpadword() const { return (_nblocks%64 == 0) ? ~uint64_t(0) : ~(~uint64_t(0) << (_nblocks%64)); }
+
+    void _fillZero() { // zero all blocks (and summary), ignoring the flag
+        _fillBlocks(0, _nblocks, alloct_zero);
+        if (has_summary) { std::fill(_summary, _summary+_nsumwords(), uint64_t(0)); }
+        _ndirty = 0;
+        _count = 0;
+        _flag_zero = true;
+    }
+
+    void _fillBlocks(const SizeT first, const SizeT last, const AllocT value) { // fill blocks [first, last) with alloct_zero or alloct_all, non-temporal if streaming
+        if (has_streaming) { blockkernels::fillStream(_bytes()+first*sizeof(AllocT), static_cast<unsigned char>(value), static_cast<size_t>(last-first)*sizeof(AllocT)); }
+        else { std::fill(_blocks+first, _blocks+last, value); }
+    }
+
+    SizeT _dirtycap() const { return _nblocks/dirty_fraction + 1; } // capacity of the dirty list
+
+    void _assignOr(const OnewayBitset * const * operands, const size_t noperands, const bool keepSelf = true) // this = OR of operands of our size
+    {   // pass keepSelf=false if our content is stale (e.g. after _setSize), then this as operand counts like another size
+        bool self = false; // this is one of the operands, so we can OR into the current content
+        for (size_t i=0; i<noperands; ++i) { self = self || (keepSelf && operands[i] == this); }
+        if (has_summary || has_dirtylist) { // keep it simple: (reset and) merge one by one
+            if (!self) { reset(); }
+            for (size_t i=0; i<noperands; ++i) { if (operands[i] != this) { merge(*operands[i]); } }
+            return;
+        }
+        std::vector<const unsigned char *> srcs;
+        srcs.reserve(noperands);
+        for (size_t i=0; i<noperands; ++i) {
+            if (operands[i] != this && operands[i]->_nbits == _nbits && !operands[i]->_flag_zero) { srcs.push_back(operands[i]->_bytes()); }
+        }
+        if (srcs.empty()) {
+            if (!self) { reset(); }
+            return;
+        }
+        for (size_t i=0; i<srcs.size(); i+=mergeall_batch) {
+            const size_t nsrcs = std::min(mergeall_batch, srcs.size()-i);
+            if (i == 0 && !self) { blockkernels::orManyTo(_bytes(), srcs.data(), nsrcs, getNBytes()); } // no need to load this
+            else { blockkernels::orManyInto(_bytes(), srcs.data()+i, nsrcs, getNBytes()); }
+        }
+        if (has_counting) { _count = _countTouched(); }
+        _flag_zero = false;
+    }
+
+    void _touch(const SizeT blkidx) { // mark block as touched in summary / dirty list, call before modifying it
+        if (has_summary) { _summary[blkidx/64] |= uint64_t(1) << (blkidx%64); }
+        if (has_dirtylist) {
+            if (_blocks[blkidx] == alloct_zero && _ndirty <= _dirtycap()) { // block turns dirty now
+                if (_ndirty < _dirtycap()) { _dirty[_ndirty] = blkidx; }
+                ++_ndirty; // == _dirtycap()+1 marks overflow
+            }
+        }
+    }
+
+    SizeT _findFrom(const SizeT index) const // first set bit at or after index, or npos
+    {
+        if (_flag_zero || index >= _nbits) { return npos; }
+        SizeT blkidx = index/blocksize;
+        const AllocT first = static_cast<AllocT>(_blocks[blkidx] & static_cast<AllocT>(alloct_all << static_cast<AllocT>(index%blocksize)));
+        if (first) { return static_cast<SizeT>(blkidx*blocksize + blockkernels::ctz64(first)); }
+        ++blkidx;
+        if (has_summary) { // jump from touched block to touched block
+            for (SizeT w=blkidx/64; w<_nsumwords(); ++w) {
+                uint64_t word = (w == blkidx/64) ? (_summary[w] & (~uint64_t(0) << (blkidx%64))) : _summary[w];
+                for (; word; word &= word-1) {
+                    const SizeT b = static_cast<SizeT>(w*64 + blockkernels::ctz64(word));
+                    if (_blocks[b]) { return static_cast<SizeT>(b*blocksize + blockkernels::ctz64(_blocks[b])); }
+                }
+            }
+            return npos;
+        }
+        const SizeT b = blkidx + static_cast<SizeT>(blockkernels::findNonzero(_bytes()+blkidx*sizeof(AllocT), static_cast<size_t>(_nblocks-blkidx)*sizeof(AllocT))/sizeof(AllocT));
+        return (b < _nblocks) ? static_cast<SizeT>(b*blocksize + blockkernels::ctz64(_blocks[b])) : npos;
+    }
+
+    SizeT _rankFrom(const SizeT blkidx, SizeT count, const SizeT pos) const // count + set bits from block blkidx up to pos
+    {
+        const SizeT lastblk = pos/blocksize;
+        count += static_cast<SizeT>(blockkernels::popcount(_bytes()+blkidx*sizeof(AllocT), static_cast<size_t>(lastblk-blkidx)*sizeof(AllocT)));
+        const AllocT bitidx = pos%blocksize;
+        if (bitidx > 0) { count += static_cast<SizeT>(blockkernels::popcount64(_blocks[lastblk] & static_cast<AllocT>(~(alloct_all << bitidx)))); }
+        return count;
+    }
+
+    SizeT _selectFrom(SizeT blkidx, SizeT k) const // set bit of rank k, counted from block blkidx on, or npos
+    {
+        const SizeT chunkblks = rank_sample_bits/blocksize;
+        for (; blkidx+chunkblks<=_nblocks; blkidx+=chunkblks) { // skip whole chunks of 512 byte
+            const SizeT c = static_cast<SizeT>(blockkernels::popcount(_bytes()+blkidx*sizeof(AllocT), static_cast<size_t>(chunkblks)*sizeof(AllocT)));
+            if (c > k) { break; }
+            k -= c;
+        }
+        for (; blkidx<_nblocks; ++blkidx) {
+            const SizeT c = static_cast<SizeT>(blockkernels::popcount64(_blocks[blkidx]));
+            if (c > k) {
+                uint64_t blkval = _blocks[blkidx];
+                for (; k>0; --k) { blkval &= blkval-1; } // clear the k lower set bits
+                return static_cast<SizeT>(blkidx*blocksize + blockkernels::ctz64(blkval));
+            }
+            k -= c;
+        }
+        return npos;
+    }
+
+    SizeT _countTouched() const { // popcount over all blocks (or only the touched ones, if we have a summary)
+        if (has_summary) {
+            SizeT count = 0;
+            _forEachTouchedBlock([this, &count](const SizeT blkidx) { count += blockkernels::popcount64(_blocks[blkidx]); });
+            return count;
+        }
+        if (has_streaming) { return static_cast<SizeT>( blockkernels::popcountStream(_bytes(), getNBytes()) ); }
+        return static_cast<SizeT>( blockkernels::popcount(_bytes(), getNBytes()) );
+    }
+
+    void _orBlock(const SizeT blkidx, const AllocT mask) { // OR mask into block (without setting the flag)
+        if (mask == alloct_zero) { return; }
+        _touch(blkidx);
+        if (has_counting) { _count += static_cast<SizeT>(blockkernels::popcount64(static_cast<AllocT>(mask & ~_blocks[blkidx]))); }
+        _blocks[blkidx] |= mask;
+    }
+
+    template <typename Callback>
+    static void _forEachBit(uint64_t word, Callback && callback) { // callback(bitidx) for every set bit of word
+        while ( word ) {
+            callback(blockkernels::ctz64(word));
+            word &= word-1;
+        }
+    }
+
+    template <typename Callback>
+    void _forEachTouchedBlock(Callback && callback) const // callback(blkidx) for every block that may be non-zero
+    {
+        if (has_summary) {
+            for (SizeT w=0; w<_nsumwords(); ++w) {
+                _forEachBit(_summary[w], [w, &callback](const unsigned bit) { callback(static_cast<SizeT>(w*64+bit)); });
+            }
+        }
+        else {
+            for (SizeT blkidx=0; blkidx<_nblocks; ++blkidx) { callback(blkidx); }
+        }
+    }
+};
+
+template <class BF, size_t N>
+struct OnewayOrExpr
+// Unevaluated OR (merge) of N bitsets, created by operator+ (see OnewayBitset)
+{
+    const BF * operands[N];
+
+    auto count() const // count of the result, without materializing it for two operands of equal size
+    {   // (the result ignores operands of another size than the first, like merge, but countUnion returns 0 then)
+        return (N == 2 && operands[0]->getNBits() == operands[1]->getNBits()) ? operands[0]->countUnion(*operands[1]) : BF(*this).count();
     }
 };
 
+template <class BF, size_t N>
+OnewayOrExpr<BF, N+1> operator+(const OnewayOrExpr<BF, N> &lhs, const BF &rhs)
+{
+    OnewayOrExpr<BF, N+1> expr;
+    std::copy(lhs.operands, lhs.operands+N, expr.operands);
+    expr.operands[N] = &rhs;
+    return expr;
+}
+
+template <class BF, size_t N>
+OnewayOrExpr<BF, N+1> operator+(const BF &lhs, const OnewayOrExpr<BF, N> &rhs)
+{
+    OnewayOrExpr<BF, N+1> expr;
+    expr.operands[0] = &lhs;
+    std::copy(rhs.operands, rhs.operands+N, expr.operands+1);
+    return expr;
+}
+
+template <class BF, size_t N, size_t M>
+OnewayOrExpr<BF, N+M> operator+(const OnewayOrExpr<BF, N> &lhs, const OnewayOrExpr<BF, M> &rhs)
+{
+    OnewayOrExpr<BF, N+M> expr;
+    std::copy(lhs.operands, lhs.operands+N, expr.operands);
+    std::copy(rhs.operands, rhs.operands+M, expr.operands+N);
+    return expr;
+}
+
+// definitions of the static members (needed pre C++17, when they are odr-used, e.g. by std::fill)
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr AllocT OnewayBitset<SizeT, AllocT, Opts, StorageT>::blocksize;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr AllocT OnewayBitset<SizeT, AllocT, Opts, StorageT>::alloct_one;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr AllocT OnewayBitset<SizeT, AllocT, Opts, StorageT>::alloct_zero;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr AllocT OnewayBitset<SizeT, AllocT, Opts, StorageT>::alloct_all;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr size_t OnewayBitset<SizeT, AllocT, Opts, StorageT>::mergeall_batch;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr SizeT OnewayBitset<SizeT, AllocT, Opts, StorageT>::npos;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr SizeT OnewayBitset<SizeT, AllocT, Opts, StorageT>::rank_sample_bits;
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT> constexpr SizeT OnewayBitset<SizeT, AllocT, Opts, StorageT>::RankIndex::_sampleblks;
+
 
 #endif
@@ -0,0 +1,126 @@
+/* class ShardedOnewayBitset
+   Author: Jan Kessler (2019)
+
+   One OnewayBitset per thread for one shared mask, combined by a parallel OR-reduction.
+*/
+
+#ifndef SHARDED_ONEWAY_BITSET_HPP
+#define SHARDED_ONEWAY_BITSET_HPP
+
+#include "OnewayBitset.hpp"
+#include "ThreadPool.hpp"
+#include "storage.hpp"
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+template <
+    typename SizeT, /* integral index type (e.g. int or size_t) */
+    typename AllocT, /* integral memory type, defines blocksize (e.g. uint8_t or uint64_t) */
+    unsigned Opts = onewayopt::none /* onewayopt flags of the shards and the result */
+    >
+class ShardedOnewayBitset
+// Alternative to AtomicOnewayBitset, for threads that set bits of the same mask at a high
+// rate. If they share one OnewayBitset (or atomic blocks), every set() of one thread can
+// invalidate the cache line of a block (or of the flag) that another thread just wrote.
+// Here every thread t sets bits only in its own shard(t), so nothing is written to shared
+// cache lines. At a synchronization point (when all setters are done, e.g. after
+// ThreadPool::run returned), reduce(pool) ORs all shards into getResult(), with every
+// worker streaming its chunk of the blocks of all shards (see OnewayBitset::mergeAll):
+//   ShardedOnewayBitset<int, uint64_t> changed(ndim, pool);
+//   pool.run([&](const int t) { ... changed.shard(t).set(i); ... });
+//   changed.reduce(pool); // getResult() |= shard(0) | shard(1) | ...
+//   ... use changed.getResult() ...
+//   changed.reset(pool); // result and all shards
+//
+// Each shard is a separate allocation with its blocks aligned to a cache line (AlignedStorage)
+// and its members padded to a cache line on both sides, so the shards share no cache lines.
+// Constructing with a pool lets worker t allocate and zero shard t itself, i.e. on NUMA
+// systems its blocks are placed (first touch) on the node of the thread that sets them.
+// The reduction costs a pass over nshards+1 bitsets, so it pays off when there are many
+// sets per reduction, or when the same mask with atomics would be contended.
+{
+public:
+    using BitsetT = OnewayBitset<SizeT, AllocT, Opts, AlignedStorage<64>>;
+
+private:
+    struct _Shard // padded, so that no other data shares a cache line with the shard's members
+    {
+        char _pad0[64];
+        BitsetT bits;
+        char _pad1[64];
+
+        explicit _Shard(const SizeT n_bits): bits(n_bits) {}
+    };
+
+    std::vector<std::unique_ptr<_Shard>> _shards;
+    BitsetT _result;
+
+public:
+    // --- Constructors (not copyable, share it by reference)
+
+    ShardedOnewayBitset(const SizeT n_bits, const int nshards): _shards(static_cast<size_t>(std::max(1, nshards))), _result(n_bits)
+    {
+        for (auto &shard : _shards) { shard.reset(new _Shard(n_bits)); }
+    }
+
+    ShardedOnewayBitset(const SizeT n_bits, ThreadPool &pool): // one shard per worker, allocated (first touch) by the worker
+        _shards(static_cast<size_t>(pool.size())), _result(n_bits, pool)
+    {
+        pool.run([this, n_bits](const int t) { _shards[t].reset(new _Shard(n_bits)); });
+    }
+
+    ShardedOnewayBitset(const ShardedOnewayBitset &) = delete;
+    ShardedOnewayBitset& operator=(const ShardedOnewayBitset &) = delete;
+
+
+    // --- Getters
+
+    SizeT getNBits() const { return _result.getNBits(); }
+    int getNShards() const { return static_cast<int>(_shards.size()); }
+
+    BitsetT & shard(const int t) { return _shards[t]->bits; } // only thread t may modify shard t between reductions
+    const BitsetT & shard(const int t) const { return _shards[t]->bits; }
+
+    const BitsetT & getResult() const { return _result; } // OR of all shards, as of the last reduce()
+
+
+    // --- Reduction and reset (call at synchronization points, i.e. not concurrently with setters)
+
+    void reduce() // result |= OR of all shards
+    {
+        std::vector<const BitsetT *> shards = _shardPointers();
+        _result.mergeAll(shards.data(), shards.size());
+    }
+
+    void reduce(ThreadPool &pool) // parallel reduce, every worker ORs its chunk of the blocks of all shards
+    {
+        std::vector<const BitsetT *> shards = _shardPointers();
+        _result.mergeAll(shards.data(), shards.size(), pool);
+    }
+
+    void resetShards() { for (auto &shard : _shards) { shard->bits.reset(); } }
+
+    void resetShards(ThreadPool &pool) // every worker resets its own shard (or shards, with more shards than workers)
+    {
+        pool.run([this, &pool](const int t) {
+            for (size_t i=static_cast<size_t>(t); i<_shards.size(); i+=static_cast<size_t>(pool.size())) { _shards[i]->bits.reset(); }
+        });
+    }
+
+    void reset() { resetShards(); _result.reset(); }
+    void reset(ThreadPool &pool) { resetShards(pool); _result.reset(pool); }
+
+private:
+    std::vector<const BitsetT *> _shardPointers() const
+    {
+        std::vector<const BitsetT *> shards;
+        shards.reserve(_shards.size());
+        for (const auto &shard : _shards) { shards.push_back(&shard->bits); }
+        return shards;
+    }
+};
+
+
+#endif
@@ -0,0 +1,123 @@
+/* class ThreadPool
+   Author: Jan Kessler (2019)
+
+   Minimal fixed-size pool of pinned worker threads, used for the parallel
+   bulk operations of OnewayBitset.
+*/
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+class ThreadPool
+// Runs a task on all workers at once: run(task) calls task(t) on worker t, for every
+// t in [0, size()), and returns when all of them are done. Worker t always runs the
+// t-th share of the work, so if memory is first touched through the pool (e.g. by
+// OnewayBitset(nbits, pool)), each worker keeps processing pages on its own NUMA
+// node later. For that the workers are pinned to the 1st, 2nd, ... CPU that the process
+// may run on (its affinity mask, as set by taskset, cgroups or MPI rank binding), wrapping
+// around if there are more workers than CPUs (Linux only). If the mask can't be read or
+// pinning fails, the workers are left unpinned, see isPinned().
+// Remember to link with -pthread.
+{
+public:
+    explicit ThreadPool(const int nthreads = static_cast<int>(std::thread::hardware_concurrency()), const bool pin = true):
+        _task(nullptr), _generation(0), _ndone(0), _stop(false), _pinned(false)
+    {
+        const int n = std::max(1, nthreads);
+#ifdef __linux__
+        std::vector<int> cpus; // CPUs we are allowed to run on, in ascending order
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (pin && sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0) {
+            for (int cpu=0; cpu<CPU_SETSIZE; ++cpu) { if (CPU_ISSET(cpu, &allowed)) { cpus.push_back(cpu); } }
+        }
+        _pinned = !cpus.empty();
+#else
+        (void)pin;
+#endif
+        for (int t=0; t<n; ++t) {
+            _workers.emplace_back([this, t]() { _workerLoop(t); });
+#ifdef __linux__
+            if (_pinned) {
+                cpu_set_t cpuset;
+                CPU_ZERO(&cpuset);
+                CPU_SET(cpus[static_cast<size_t>(t) % cpus.size()], &cpuset);
+                if (pthread_setaffinity_np(_workers.back().native_handle(), sizeof(cpu_set_t), &cpuset) != 0) { _pinned = false; } // stays runnable on the allowed set
+            }
+#endif
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool& operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv_start.notify_all();
+        for (auto &worker : _workers) { worker.join(); }
+    }
+
+    int size() const { return static_cast<int>(_workers.size()); }
+    bool isPinned() const { return _pinned; } // all workers are pinned to a CPU of the affinity mask
+
+    void run(const std::function<void(int)> &task) // blocks until task(t) has returned on every worker t
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _task = &task;
+        _ndone = 0;
+        ++_generation;
+        _cv_start.notify_all();
+        _cv_done.wait(lock, [this]() { return _ndone == size(); });
+        _task = nullptr;
+    }
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _cv_start, _cv_done;
+    const std::function<void(int)> * _task;
+    unsigned long _generation; // incremented for every run()
+    int _ndone; // number of workers done with current task
+    bool _stop;
+    bool _pinned;
+
+    void _workerLoop(const int t)
+    {
+        unsigned long seen = 0;
+        while (true) {
+            const std::function<void(int)> * task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv_start.wait(lock, [this, seen]() { return _stop || _generation != seen; });
+                if (_stop) { return; }
+                seen = _generation;
+                task = _task;
+            }
+            (*task)(t);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                ++_ndone;
+            }
+            _cv_done.notify_one();
+        }
+    }
+};
+
+
+#endif
@@ -0,0 +1,127 @@
+#include "OnewayBitset.hpp"
+#include "AtomicOnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+// Benchmark of a shared atomic change mask vs per-thread masks merged at the end
+//
+// A fixed total number of random bits (nset) is set by nthreads worker threads (strong scaling),
+// either into one shared AtomicOnewayBitset, or each thread into its own OnewayBitset, which are
+// merged into one result bitset after joining the threads (time of the merge included).
+//
+// We compare the following approaches:
+// Approach 1 (Atomic): All threads set() on the same AtomicOnewayBitset (fetch_or).
+// Approach 2 (Local+Merge): Every thread sets on a private OnewayBitset, then merge all.
+//
+// The following settings are configured:
+// 5 runs per benchmark, nset = 1e7 random bits in total, nthreads = 1, 2, 4, ... up to the
+// number of hardware threads, and bitsets of 1 MBit (cache-resident, much contention) and
+// 1 GBit (memory-bound, little contention).
+//
+// Expectation: For the large bitset the atomic mask scales nicely, because collisions on
+// the same cache line are rare, while the local approach pays nthreads merges over 128 MB
+// (and needs nthreads times the memory).
+// For the small bitset the local approach should scale better, as there the atomic setters
+// keep stealing cache lines from each other.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+
+
+inline uint64_t xorshift64(uint64_t &state) // fast thread-private random numbers
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+double benchmark_atomic(AtomicOnewayBitset<BenchSizeT, BenchAllocT> &shared, const BenchSizeT nset, const int nthreads)
+{
+    Timer timer(1.);
+    shared.reset();
+    timer.reset();
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; ++t) {
+        threads.emplace_back([&shared, nset, nthreads, t]() {
+            uint64_t state = 1337 + t;
+            const BenchSizeT nbits = shared.getNBits();
+            for (BenchSizeT i=0; i<nset/nthreads; ++i) { shared.set(xorshift64(state) % nbits); }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+    const double time = timer.elapsed();
+    std::cout << shared.count() << " ";
+    return time;
+}
+
+double benchmark_local(std::vector< OnewayBitset<BenchSizeT, BenchAllocT> > &locals, OnewayBitset<BenchSizeT, BenchAllocT> &result, const BenchSizeT nset, const int nthreads)
+{
+    Timer timer(1.);
+    result.reset();
+    for (int t=0; t<nthreads; ++t) { locals[t].reset(); }
+    timer.reset();
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; ++t) {
+        threads.emplace_back([&locals, nset, nthreads, t]() {
+            uint64_t state = 1337 + t;
+            const BenchSizeT nbits = locals[t].getNBits();
+            for (BenchSizeT i=0; i<nset/nthreads; ++i) { locals[t].set(xorshift64(state) % nbits); }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+    for (int t=0; t<nthreads; ++t) { result.merge(locals[t]); }
+    const double time = timer.elapsed();
+    std::cout << result.count() << " ";
+    return time;
+}
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << std::endl << label << ":" << std::setw(std::max(1, 36-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nset = 10000000UL;
+    const BenchSizeT nbitsList[2] = {1000000UL, 1000000000UL};
+    const int maxthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (total time for setting " << nset << " bits):" << std::endl;
+
+    for (const BenchSizeT nbits : nbitsList) {
+        AtomicOnewayBitset<BenchSizeT, BenchAllocT> shared(nbits);
+        OnewayBitset<BenchSizeT, BenchAllocT> result(nbits);
+        std::vector< OnewayBitset<BenchSizeT, BenchAllocT> > locals;
+        locals.reserve(maxthreads);
+
+        for (int nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+            while (static_cast<int>(locals.size()) < nthreads) { locals.emplace_back(nbits); }
+
+            std::string label = "nbits " + std::to_string(nbits) + ", threads " + std::to_string(nthreads);
+            print_result("t ( atomic, " + label + " )", sample_benchmark([&] { return benchmark_atomic(shared, nset, nthreads); }, nruns));
+            print_result("t ( local,  " + label + " )", sample_benchmark([&] { return benchmark_local(locals, result, nset, nthreads); }, nruns));
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "OnewayBitset.hpp"
+#include "CompressedOnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of compressed vs dense one-way bitsets
+//
+// For several densities we fill two bitsets of each kind with the same bits and measure
+// the memory footprint and the time of merge() and count().
+//
+// We compare the following approaches:
+// Approach 1 (Dense): OnewayBitset<uint64_t, uint64_t>
+// Approach 2 (Compressed): CompressedOnewayBitset<uint64_t>, after runOptimize()
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit bitsets, random bits with densities 1e-6, 1e-4, 1e-2 and 0.5,
+// and one clustered pattern (runs of 10000 set bits, density 1e-2).
+//
+// Expectation: Up to a density of about 1/16 (4096 bits per chunk of 65536) the compressed
+// bitset needs less memory and is faster, because it only touches the set bits. Above that
+// the chunks turn into bitmaps and it should be a bit slower than the dense one, unless the
+// bits are clustered, in which case the run containers stay tiny at any density.
+// Result (1 GBit, AVX-512 machine): count() of the compressed bitset returns its running count,
+// i.e. it takes nanoseconds instead of 8-11 ms. At 1e-6 and for the clustered bits the compressed
+// merge is 250x faster (0.06-0.07 vs 16-19 ms), at 1e-4 7x, at 0.5 it is 25% slower (both
+// bitmaps). At 1e-2 the sorted array union is about 7 times slower than the dense merge (119 vs
+// 17 ms), while using 1/6 of the memory (20 vs 119 MB).
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using DenseBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+using CompressedBF = CompressedOnewayBitset<BenchSizeT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 40-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+void print_memory(const std::string &label, const size_t bytes)
+{
+    std::cout << label << ":" << std::setw(std::max(1, 40-static_cast<int>(label.length()))) << std::setfill(' ') << " " << bytes/1048576. << " MB" << std::endl;
+}
+
+template <class BF>
+void run_benchmarks(const std::string &label, BF &bitset1, const BF &bitset2, const int nruns)
+{
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( merge, " + label + " )", sample_benchmark([&] {
+        BF target(bitset1); // merge is idempotent, so merge into a fresh copy every time
+        timer.reset();
+        target.merge(bitset2);
+        const double time = timer.elapsed();
+        sink += target.count();
+        return time;
+    }, nruns));
+
+    print_result("t ( count, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += bitset1.count();
+        return timer.elapsed();
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+}
+
+template <class Generator>
+void benchmark_pattern(const std::string &label, const BenchSizeT nbits, Generator && generator, const int nruns)
+{
+    DenseBF dense1(nbits), dense2(nbits);
+    CompressedBF compressed1(nbits), compressed2(nbits);
+    generator([&](const BenchSizeT i) { dense1.set(i); compressed1.set(i); }, 1);
+    generator([&](const BenchSizeT i) { dense2.set(i); compressed2.set(i); }, 2);
+    compressed1.runOptimize();
+    compressed2.runOptimize();
+
+    std::cout << label << " (" << dense1.count() << " bits set):" << std::endl;
+    print_memory("m ( dense )", dense1.getNBytes());
+    print_memory("m ( compressed )", compressed1.memoryBytes());
+    run_benchmarks("dense", dense1, dense2, nruns);
+    run_benchmarks("compressed", compressed1, compressed2, nruns);
+    std::cout << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const double densities[4] = {1e-6, 1e-4, 1e-2, 0.5};
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    for (const double density : densities) {
+        benchmark_pattern("random, density " + std::to_string(density), nbits, [nbits, density](const std::function<void(BenchSizeT)> &set, const uint64_t seed) {
+            uint64_t state = 1337*seed;
+            const BenchSizeT nset = static_cast<BenchSizeT>(density*nbits);
+            for (BenchSizeT k=0; k<nset; ++k) {
+                state = state*6364136223846793005ULL + 1442695040888963407ULL;
+                set((state >> 16) % nbits);
+            }
+        }, nruns);
+    }
+    benchmark_pattern("clustered, density 0.01", nbits, [nbits](const std::function<void(BenchSizeT)> &set, const uint64_t seed) {
+        for (BenchSizeT start=seed*10000; start+10000<=nbits; start+=1000000) {
+            for (BenchSizeT i=start; i<start+10000; ++i) { set(i); }
+        }
+    }, nruns);
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
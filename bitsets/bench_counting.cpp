@@ -0,0 +1,116 @@
+#include "OnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+
+// Benchmark of the running count of onewayopt::counting
+//
+// We compare the following approaches:
+// Approach 1 (Plain): OnewayBitset without options, count() is a vectorized popcount
+// Approach 2 (Counting): OnewayBitset with onewayopt::counting, count() returns the counter
+//
+// For both we time what the counter costs (random set(), setRange(), merge(), mergeAll())
+// and what it saves (count()).
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit bitsets (125 MB each), 10^7 random sets,
+// merge of a bitset with every 3rd bit set, mergeAll of 4 such bitsets.
+//
+// Expectation: count() becomes free instead of a pass over memory. set() needs the old
+// block anyway, so the counter should only cost an add (random sets are dominated by cache
+// misses). merge() counts in the same pass and should be as fast as before, mergeAll()
+// needs an extra popcount pass, i.e. it costs about one count() more.
+// Result (1 GBit, AVX-512 machine): count() goes from 7.4 ms to nothing. merge() takes 25% longer
+// (16.9 vs 13.4 ms), i.e. counting in the same pass is not free at this size, and mergeAll() of 4
+// sources 17% (45.7 vs 39.1 ms), about one count() more, as expected. setRange() takes 2x as long,
+// because the range is popcounted before the fill. Random set() is about 20% slower, more than
+// expected: the counter is a member, which the compiler has to load and store in every call,
+// since it can alias the blocks.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 30-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+template <class BF>
+void run_benchmarks(const std::string &label, const BenchSizeT nbits, const BenchSizeT nsets, const int nruns)
+{
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+    BF bitset(nbits), strided(nbits);
+    strided.setStrided(0, 3);
+    std::vector<BF> others(4, strided);
+    std::vector<const BF *> otherptrs;
+    for (const BF &other : others) { otherptrs.push_back(&other); }
+
+    print_result("t ( random set, " + label + " )", sample_benchmark([&] {
+        uint64_t state = 1337;
+        bitset.reset();
+        timer.reset();
+        for (BenchSizeT k=0; k<nsets; ++k) {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            bitset.set((state >> 16) % nbits);
+        }
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( count, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += bitset.count();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( setRange, " + label + " )", sample_benchmark([&] {
+        bitset.reset();
+        timer.reset();
+        bitset.setRange(nbits/4, 3*nbits/4);
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( merge, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset.merge(strided);
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( mergeAll, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset.mergeAll(otherptrs.data(), otherptrs.size());
+        return timer.elapsed();
+    }, nruns));
+
+    std::cout << "(checksum " << sink + bitset.count() << ")" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const BenchSizeT nsets = 10000000UL;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    run_benchmarks< OnewayBitset<BenchSizeT, BenchAllocT> >("plain", nbits, nsets, nruns);
+    run_benchmarks< OnewayBitset<BenchSizeT, BenchAllocT, onewayopt::counting> >("counting", nbits, nsets, nruns);
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
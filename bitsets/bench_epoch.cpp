@@ -0,0 +1,97 @@
+#include "OnewayBitset.hpp"
+#include "EpochBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of fill-based vs epoch-based reset of huge bitsets
+//
+// We emulate the usage pattern of OnewayBitset ("set bits iteratively, then periodically
+// reset the entire bitset") on a 20 GBit bitset, with a varying number of bits set per step.
+// One step consists of setting nset random bits and resetting the bitset afterwards.
+//
+// We compare the following approaches:
+// Approach 1 (Fill): OnewayBitset, reset() fills all 2.5 GB of blocks with zeros.
+// Approach 2 (Epoch): EpochBitset, reset() increments the generation counter.
+//
+// The following settings are configured:
+// 5 runs per benchmark, 4 steps per run, nset of 1e3, 1e5 and 1e7 bits per step.
+// Both bitsets use uint64_t blocks. Be aware that the EpochBitset needs 16 byte per
+// block (8 byte bits + 4 byte generation + padding), i.e. 5 GB for 20 GBit.
+//
+// Expectation: The fill-based step time is dominated by the reset, i.e. by memory bandwidth
+// over the whole bitset, and barely depends on nset. The epoch-based step time scales with nset
+// only (every first write to a block costs an extra stamp check/write), so it should win by
+// orders of magnitude for sparse steps and lose its advantage once most blocks get touched.
+//
+// Result (GCC 12: g++ -O3 -march=native, 20 GBit, 6 GB machine): Fill needs ~214 ms per step at
+// nset=1e3 (the 2.5 GB reset), epoch ~0.05 ms. At nset=1e5 fill takes 238 ms and epoch 7 ms, and
+// at nset=1e7 (random writes dominate) epoch is still ~20% faster (780 vs 970 ms).
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+
+
+template <class BF>
+double benchmark_step(BF &bitset, const BenchSizeT nset, const int nsteps)
+{
+    Timer timer(1.);
+    srand(1337);
+    timer.reset();
+    for (int step=0; step<nsteps; ++step) {
+        for (BenchSizeT i=0; i<nset; ++i) { // cheap pseudo-random indices, spread over the whole bitset
+            bitset.set( (static_cast<BenchSizeT>(rand())*static_cast<BenchSizeT>(RAND_MAX) + rand()) % bitset.getNBits() );
+        }
+        bitset.reset();
+    }
+    return timer.elapsed();
+}
+
+template <class BF>
+void run_single_benchmark(const std::string &label, BF &bitset, const int nruns, const int nsteps, const BenchSizeT nset)
+{
+    std::pair<double, double> result;
+    const double time_scale = 1000.; // milliseconds
+
+    result = sample_benchmark([&] { return benchmark_step(bitset, nset, nsteps); }, nruns);
+    std::cout << label << ":" << std::setw(std::max(1, 32-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first/nsteps*time_scale << " +- " << result.second/nsteps*time_scale << " milliseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const int nsteps = 4;
+    const BenchSizeT nbits = 20000000000UL;
+    const BenchSizeT nsets[3] = {1000UL, 100000UL, 10000000UL};
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (time per step, " << nbits << " bits):" << std::endl << std::endl;
+
+    { // fill-based (one bitset at a time, to limit memory)
+        OnewayBitset<BenchSizeT, BenchAllocT> bitset(nbits);
+        for (const BenchSizeT nset : nsets) {
+            run_single_benchmark("t/step ( fill,  nset " + std::to_string(nset) + " )", bitset, nruns, nsteps, nset);
+        }
+    }
+    std::cout << std::endl;
+    { // epoch-based
+        EpochBitset<BenchSizeT, BenchAllocT> bitset(nbits);
+        for (const BenchSizeT nset : nsets) {
+            run_single_benchmark("t/step ( epoch, nset " + std::to_string(nset) + " )", bitset, nruns, nsteps, nset);
+        }
+    }
+    std::cout << std::endl << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
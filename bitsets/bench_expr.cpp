@@ -0,0 +1,95 @@
+#include "OnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of lazy (expression template) vs eager evaluation of d = a + b + c
+//
+// We compare the following approaches:
+// Approach 1 (Eager): What d = a + b + c did before operator+ became lazy: operator+ took
+// its lhs by value and there was no move constructor, so every + copied a whole bitset.
+// That is: t1 = copy of a, t1 |= b, t2 = copy of t1, t2 |= c, d = t2 (copy assignment).
+// Approach 2 (Lazy): d = a + b + c, i.e. one pass over a, b and c, writing d once.
+// Approach 3 (Lazy, in place): d = d + a + b + c, i.e. d is loaded too (like d += a + b + c).
+//
+// The following settings are configured:
+// 5 runs per benchmark, 2 GBit bitsets (250 MB each), every 3rd/5th/7th bit set in a/b/c.
+//
+// Expectation: The eager version allocates two temporaries (page faults!) and moves
+// about 9 bitsets through memory, the lazy one 4, so we expect at least 2x.
+// Result (2 GBit, AVX-512 machine, 1 core): lazy is about 5x faster than eager (95 vs 465 ms,
+// eager spends most of its time faulting in the pages of the temporaries). Lazy in place takes
+// the same time as lazy (99 ms) although it loads d too, presumably because its stores hit
+// cache lines it just loaded.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using BenchBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 28-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 2000000000UL;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    BenchBF a(nbits), b(nbits), c(nbits), d(nbits);
+    a.setStrided(0, 3);
+    b.setStrided(0, 5);
+    c.setStrided(0, 7);
+    d.setAll(); // touch all pages once
+
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( eager )", sample_benchmark([&] {
+        timer.reset();
+        BenchBF t1(a);
+        t1 += b;
+        BenchBF t2(t1);
+        t2 += c;
+        d = t2;
+        const double time = timer.elapsed();
+        sink += d.count();
+        return time;
+    }, nruns));
+
+    print_result("t ( lazy )", sample_benchmark([&] {
+        timer.reset();
+        d = a + b + c;
+        const double time = timer.elapsed();
+        sink += d.count();
+        return time;
+    }, nruns));
+
+    print_result("t ( lazy, in place )", sample_benchmark([&] {
+        timer.reset();
+        d = d + a + b + c;
+        const double time = timer.elapsed();
+        sink += d.count();
+        return time;
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
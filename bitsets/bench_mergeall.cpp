@@ -0,0 +1,94 @@
+#include "OnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+
+// Benchmark of N-way merging vs repeated pairwise merging
+//
+// A result bitset is merged with nsrcs source bitsets (e.g. the change masks of many walkers).
+//
+// We compare the following approaches:
+// Approach 1 (Pairwise): for every source: result += source
+// Approach 2 (MergeAll): result.mergeAll(sources, nsrcs)
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit bitsets (125 MB each), nsrcs = 2, 4, 8 and 16,
+// every (2k+1)-th bit set in source k.
+//
+// Expectation: Pairwise merging loads and stores the result nsrcs times, i.e. it moves
+// 3*nsrcs bitsets through the memory bus, while mergeAll needs nsrcs+2. So for many
+// sources we expect mergeAll to approach a 3x speedup.
+// Result (1 GBit, AVX-512 machine, 1 core): mergeAll is 1.4x faster for 2 sources, 1.5x for 4 and
+// 1.8x for 8 and 16 (144 vs 260 ms), i.e. less than expected, as the many concurrent read streams
+// cost bandwidth too.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using BenchBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 32-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const size_t nsrcsList[4] = {2, 4, 8, 16};
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    std::vector<BenchBF> srcs;
+    srcs.reserve(nsrcsList[3]);
+    for (size_t k=0; k<nsrcsList[3]; ++k) {
+        srcs.emplace_back(nbits);
+        srcs.back().setStrided(k, 2*k+1);
+    }
+    std::vector<const BenchBF *> ptrs;
+    for (const BenchBF &src : srcs) { ptrs.push_back(&src); }
+
+    BenchBF result(nbits);
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+    for (const size_t nsrcs : nsrcsList) {
+        print_result("t ( pairwise, " + std::to_string(nsrcs) + " srcs )", sample_benchmark([&] {
+            result.reset();
+            result.set(0);
+            timer.reset();
+            for (size_t k=0; k<nsrcs; ++k) { result += srcs[k]; }
+            const double time = timer.elapsed();
+            sink += result.count();
+            return time;
+        }, nruns));
+
+        print_result("t ( mergeAll, " + std::to_string(nsrcs) + " srcs )", sample_benchmark([&] {
+            result.reset();
+            result.set(0);
+            timer.reset();
+            result.mergeAll(ptrs.data(), nsrcs);
+            const double time = timer.elapsed();
+            sink += result.count();
+            return time;
+        }, nruns));
+        std::cout << std::endl;
+    }
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include "OnewayBitset.hpp"
+#include "MultiOnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of many small change masks, one per observable
+//
+// A walker with ndim coordinates and nobs observables, where each observable depends on a few
+// coordinates. Each observable keeps a mask of the coordinates that changed since it was last
+// computed: a changed coordinate i sets bit i in the masks of all observables depending on it.
+//
+// We compare the following approaches:
+// Approach 1 (Separate): std::vector of nobs OnewayBitsets, i.e. one allocation per mask
+// Approach 2 (Multi): MultiOnewayBitset with nobs masks, stored bit-sliced in one allocation,
+//            i.e. coordinate i is one row of nobs bits
+// for the following operations:
+// - update: for ndim/10 random coordinates, set the bit in the masks of their dependents (row OR)
+// - query: for every coordinate, collect the observables whose mask has its bit set
+// - union: merge all masks into one mask of the changed coordinates
+// - reset: reset all masks
+//
+// The following settings are configured:
+// 100 runs per benchmark, 1000 repetitions per run, 64 observables, 256 and 1024 coordinates,
+// 4 dependent observables per coordinate.
+//
+// Expectation: With 64 observables a row is one uint64_t block, so the query and the update are
+// one block access per coordinate instead of one per observable (i.e. a 64 bit loop over separate
+// masks), and reset is one fill over 2-8 kB instead of 64 calls. The union reads every row once
+// instead of merging 64 masks, which is the same amount of memory but a single pass.
+// Result (1024 coordinates, AVX-512 machine): query 30x faster (3.4 vs 102 microseconds), union
+// 3.4x (0.09 vs 0.31), update 2.9x, reset 2.2x. With 256 coordinates the factors are similar,
+// reset wins 5.5x. The checksums agree, i.e. both find the same observables.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using MaskT = OnewayBitset<BenchSizeT, BenchAllocT>;
+using MultiT = MultiOnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000000.; // microseconds
+    std::cout << label << ":" << std::setw(std::max(1, 40-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " microseconds" << std::endl;
+}
+
+struct SeparateMasks
+{
+    std::vector<MaskT> masks;
+
+    SeparateMasks(const BenchSizeT ndim, const BenchSizeT nobs): masks(nobs, MaskT(ndim)) {}
+
+    void update(const BenchSizeT i, const BenchAllocT deps) { for (BenchAllocT d=deps; d; d&=d-1) { masks[blockkernels::ctz64(d)].set(i); } }
+    template <typename Callback>
+    void query(const BenchSizeT i, Callback && callback) const { for (BenchSizeT k=0; k<masks.size(); ++k) { if (masks[k].get(i)) { callback(k); } } }
+    void merged(MaskT &out) const { for (const auto &mask : masks) { out.merge(mask); } }
+    void reset() { for (auto &mask : masks) { mask.reset(); } }
+};
+
+struct MultiMasks
+{
+    MultiT multi;
+
+    MultiMasks(const BenchSizeT ndim, const BenchSizeT nobs): multi(ndim, nobs) {}
+
+    void update(const BenchSizeT i, const BenchAllocT deps) { multi.setMasksAt(i, &deps); }
+    template <typename Callback>
+    void query(const BenchSizeT i, Callback && callback) const { multi.forEachMaskAt(i, callback); }
+    void merged(MaskT &out) const { multi.mergeMasks(out); }
+    void reset() { multi.reset(); }
+};
+
+template <class MasksT>
+void run_benchmarks(const std::string &label, const BenchSizeT ndim, const BenchSizeT nobs, const std::vector<BenchAllocT> &deps, const int nreps, const int nruns)
+{
+    Timer timer(1.);
+    MasksT masks(ndim, nobs);
+    MaskT out(ndim);
+    BenchSizeT sink = 0;
+    const std::string settings = label + ", " + std::to_string(ndim) + " coords";
+
+    print_result("t ( update, " + settings + " )", sample_benchmark([&] {
+        uint64_t state = 1337;
+        timer.reset();
+        for (int rep=0; rep<nreps; ++rep) {
+            for (BenchSizeT k=0; k<ndim/10; ++k) {
+                state = state*6364136223846793005ULL + 1442695040888963407ULL;
+                const BenchSizeT i = (state >> 16) % ndim;
+                masks.update(i, deps[i]);
+            }
+        }
+        return timer.elapsed()/nreps;
+    }, nruns));
+
+    print_result("t ( query, " + settings + " )", sample_benchmark([&] {
+        timer.reset();
+        for (int rep=0; rep<nreps; ++rep) {
+            for (BenchSizeT i=0; i<ndim; ++i) { masks.query(i, [&sink](const BenchSizeT k) { sink += k; }); }
+        }
+        return timer.elapsed()/nreps;
+    }, nruns));
+
+    print_result("t ( union, " + settings + " )", sample_benchmark([&] {
+        timer.reset();
+        for (int rep=0; rep<nreps; ++rep) {
+            out.reset();
+            masks.merged(out);
+            sink += out.getNBits();
+        }
+        return timer.elapsed()/nreps;
+    }, nruns));
+    sink += out.count();
+
+    print_result("t ( reset, " + settings + " )", sample_benchmark([&] {
+        timer.reset();
+        for (int rep=0; rep<nreps; ++rep) {
+            masks.update(static_cast<BenchSizeT>(rep) % ndim, deps[static_cast<BenchSizeT>(rep) % ndim]); // so that reset() is not a no-op
+            masks.reset();
+        }
+        return timer.elapsed()/nreps;
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 100;
+    const int nreps = 1000;
+    const BenchSizeT nobs = 64; // one block per row
+    const BenchSizeT ndims[2] = {256, 1024};
+    const int ndeps = 4;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nobs << " observables, time per repetition):" << std::endl << std::endl;
+
+    for (const BenchSizeT ndim : ndims) {
+        std::vector<BenchAllocT> deps(ndim, 0); // bit k set = observable k depends on coordinate i
+        uint64_t state = 4242;
+        for (BenchSizeT i=0; i<ndim; ++i) {
+            for (int d=0; d<ndeps; ++d) {
+                state = state*6364136223846793005ULL + 1442695040888963407ULL;
+                deps[i] |= BenchAllocT(1) << ((state >> 16) % nobs);
+            }
+        }
+        run_benchmarks<SeparateMasks>("separate", ndim, nobs, deps, nreps, nruns);
+        run_benchmarks<MultiMasks>("multi", ndim, nobs, deps, nreps, nruns);
+    }
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
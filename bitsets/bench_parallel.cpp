@@ -0,0 +1,100 @@
+#include "OnewayBitset.hpp"
+#include "ThreadPool.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+
+// Benchmark of parallel bulk operations on multi-gigabit bitsets
+//
+// On two 20 GBit bitsets (2.5 GB each, like in test.cpp) we measure the sequential
+// reset(), count() and merge() and their ThreadPool overloads, for pools of 1, 2, 4, ...
+// up to the number of hardware threads. For every pool size the bitsets are constructed
+// through the pool, so that on NUMA systems the pages are first touched by the worker
+// that later processes them.
+//
+// The following settings are configured:
+// 5 runs per benchmark, every third bit set in the first and every fifth in the second.
+//
+// Expectation: A single core can't saturate the memory channels of a server CPU, so the
+// parallel versions should scale until the memory bandwidth of all NUMA nodes is reached.
+// On a desktop (dual channel) the gain should flatten out after 2-4 threads.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using BenchBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 28-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+void fill_pattern(BenchBF &bitset1, BenchBF &bitset2)
+{
+    for (BenchSizeT i=0; i<bitset1.getNBits(); i+=3) { bitset1.set(i); }
+    for (BenchSizeT i=0; i<bitset2.getNBits(); i+=5) { bitset2.set(i); }
+}
+
+void run_benchmarks(const std::string &label, BenchBF &bitset1, BenchBF &bitset2, ThreadPool * pool, const int nruns)
+{
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( count, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += pool ? bitset1.count(*pool) : bitset1.count();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( merge, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        if (pool) { bitset2.merge(bitset1, *pool); } else { bitset2.merge(bitset1); }
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( reset, " + label + " )", sample_benchmark([&] {
+        bitset2.set(0); // make sure reset has something to do
+        timer.reset();
+        if (pool) { bitset2.reset(*pool); } else { bitset2.reset(); }
+        return timer.elapsed();
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 20000000000UL;
+    const int maxthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    {
+        BenchBF bitset1(nbits), bitset2(nbits);
+        fill_pattern(bitset1, bitset2);
+        run_benchmarks("sequential", bitset1, bitset2, nullptr, nruns);
+    }
+    for (int nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+        ThreadPool pool(nthreads);
+        BenchBF bitset1(nbits, pool), bitset2(nbits, pool);
+        fill_pattern(bitset1, bitset2);
+        run_benchmarks("threads " + std::to_string(nthreads), bitset1, bitset2, &pool, nruns);
+    }
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
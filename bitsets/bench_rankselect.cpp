@@ -0,0 +1,140 @@
+#include "OnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of search, rank and select queries on a sparse change mask
+//
+// We compare the following approaches:
+// Approach 1 (get scan): what we did before, i.e. loop over get(i) to find the next set bit,
+//            or to count the set bits before a position / find the k-th set bit.
+// Approach 2 (Scan): findNext(), rank() and select() of OnewayBitset (vectorized scans)
+// Approach 3 (Index): rank() and select() of a RankIndex (built once, build time shown separately)
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit bitset with random bits of density 1e-4,
+// 1000 queries per run for the scans, 10^6 for the index, random positions / ranks.
+//
+// Expectation: findNext() should skip the empty stretches (~10 kBit on average) about as fast
+// as the memory delivers them. rank()/select() without index scan half the bitset per query
+// on average, i.e. they are bandwidth-bound like count(), the get() loops are much slower.
+// With the index both should be in the range of a cache miss or two (plus log n for select).
+// Result (1 GBit, AVX-512 machine): findNext takes 0.35 us vs 7 us with get(). The scans of
+// rank/select take ~2.4 ms per query (get() loops: ~350 ms). The index answers rank in 0.07 us and
+// select in 0.35 us, after being built in 9 ms (a bit more than one count() of 7 ms).
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using BenchBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result, const double nqueries)
+{
+    const double time_scale = 1000000./nqueries; // microseconds per query
+    std::cout << label << ":" << std::setw(std::max(1, 30-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " microseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const double density = 1e-4;
+    const BenchSizeT nscan = 1000, nindex = 1000000, ngetscan = 10;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits, time per query):" << std::endl << std::endl;
+
+    BenchBF bitset(nbits);
+    uint64_t state = 1337;
+    auto nextRand = [&state]() { state = state*6364136223846793005ULL + 1442695040888963407ULL; return state >> 16; };
+    for (BenchSizeT k=0; k<static_cast<BenchSizeT>(density*nbits); ++k) { bitset.set(nextRand() % nbits); }
+    const BenchSizeT nset = bitset.count();
+
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( findNext, get scan )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nscan; ++q) {
+            BenchSizeT i = nextRand() % nbits + 1;
+            while (i < nbits && !bitset.get(i)) { ++i; }
+            sink += i;
+        }
+        return timer.elapsed();
+    }, nruns), nscan);
+
+    print_result("t ( findNext )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nscan; ++q) { sink += bitset.findNext(nextRand() % nbits); }
+        return timer.elapsed();
+    }, nruns), nscan);
+
+    print_result("t ( rank, get scan )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<ngetscan; ++q) {
+            const BenchSizeT pos = nextRand() % nbits;
+            BenchSizeT rank = 0;
+            for (BenchSizeT i=0; i<pos; ++i) { rank += bitset.get(i); }
+            sink += rank;
+        }
+        return timer.elapsed();
+    }, nruns), ngetscan);
+
+    print_result("t ( rank, scan )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nscan; ++q) { sink += bitset.rank(nextRand() % nbits); }
+        return timer.elapsed();
+    }, nruns), nscan);
+
+    print_result("t ( select, get scan )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<ngetscan; ++q) {
+            BenchSizeT k = nextRand() % nset, i = 0;
+            for (; i<nbits; ++i) { if (bitset.get(i) && k-- == 0) { break; } }
+            sink += i;
+        }
+        return timer.elapsed();
+    }, nruns), ngetscan);
+
+    print_result("t ( select, scan )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nscan; ++q) { sink += bitset.select(nextRand() % nset); }
+        return timer.elapsed();
+    }, nruns), nscan);
+
+    print_result("t ( index build )", sample_benchmark([&] {
+        timer.reset();
+        const BenchBF::RankIndex index(bitset);
+        const double time = timer.elapsed();
+        sink += index.count();
+        return time;
+    }, nruns), 1);
+
+    const BenchBF::RankIndex index(bitset);
+    print_result("t ( rank, index )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nindex; ++q) { sink += index.rank(nextRand() % nbits); }
+        return timer.elapsed();
+    }, nruns), nindex);
+
+    print_result("t ( select, index )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT q=0; q<nindex; ++q) { sink += index.select(nextRand() % nset); }
+        return timer.elapsed();
+    }, nruns), nindex);
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "OnewayBitset.hpp"
+#include "storage.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Benchmark of checkpointing a change mask to a file and loading it again
+//
+// We compare the following approaches:
+// Approach 1 (Bool dump): getAll() into a bool array, which is written to / read from the file
+//            and loaded back by setting the bits (what we did before there was a binary format).
+// Approach 2 (Binary): write() / read(), i.e. header + raw blocks, streamed from / to the blocks.
+// Approach 3 (View): write() as before, but load by mapping the file and using it in place via
+//            ViewStorage, followed by a count() to actually touch the data.
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit bitset with every 3rd bit set, files in the working directory.
+//
+// Expectation: The bool dump is 8x bigger, so it should take at least 8x longer. Reading the
+// binary format costs about as much as writing it, while the view only has to fault in the
+// pages that are accessed (all of them for count(), but from the page cache, without a copy).
+// Result (1 GBit, AVX-512 machine, files in the page cache): writing the bool dump takes 10x
+// longer than write() (650 vs 67 ms), loading it (with the element-wise set) 38x longer than
+// read() (1070 vs 28 ms). Loading via the view (including the count) is 2x faster than read().
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using BenchBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+using ViewBF = OnewayBitset<BenchSizeT, BenchAllocT, onewayopt::none, ViewStorage>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 28-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const std::string boolpath = "bench_serialize_bool.bin", binpath = "bench_serialize.bin";
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    BenchBF mask(nbits), loaded(nbits);
+    mask.setStrided(0, 3);
+    std::unique_ptr<bool[]> bools(new bool[nbits]);
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( write, bool dump )", sample_benchmark([&] {
+        timer.reset();
+        mask.getAll(bools.get());
+        std::ofstream file(boolpath, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(bools.get()), static_cast<std::streamsize>(nbits));
+        file.close();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( read, bool dump )", sample_benchmark([&] {
+        timer.reset();
+        std::ifstream file(boolpath, std::ios::binary);
+        file.read(reinterpret_cast<char *>(bools.get()), static_cast<std::streamsize>(nbits));
+        loaded.reset();
+        for (BenchSizeT i=0; i<nbits; ++i) { if (bools[i]) { loaded.set(i); } }
+        const double time = timer.elapsed();
+        sink += loaded.count();
+        return time;
+    }, nruns));
+
+    print_result("t ( write, binary )", sample_benchmark([&] {
+        timer.reset();
+        std::ofstream file(binpath, std::ios::binary);
+        mask.write(file);
+        file.close();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( read, binary )", sample_benchmark([&] {
+        timer.reset();
+        std::ifstream file(binpath, std::ios::binary);
+        loaded.read(file);
+        const double time = timer.elapsed();
+        sink += loaded.count();
+        return time;
+    }, nruns));
+
+    print_result("t ( view + count, binary )", sample_benchmark([&] {
+        timer.reset();
+        const int fd = ::open(binpath.c_str(), O_RDONLY);
+        struct stat st;
+        ::fstat(fd, &st);
+        void * p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        {
+            ViewStorage view(p, static_cast<size_t>(st.st_size));
+            const ViewBF viewed(view.getNBits(), view);
+            sink += viewed.count();
+        }
+        const double time = timer.elapsed();
+        ::munmap(p, static_cast<size_t>(st.st_size));
+        return time;
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    std::remove(boolpath.c_str());
+    std::remove(binpath.c_str());
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "OnewayBitset.hpp"
+#include "CowOnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of periodic snapshots of a change mask
+//
+// Every step sets some random bits in a live mask and then takes a snapshot of it, the last
+// few snapshots are kept for later analysis (in a ring buffer, i.e. old ones are destroyed).
+//
+// We compare the following approaches:
+// Approach 1 (Copy): OnewayBitset, snapshots are copies (copy constructor)
+// Approach 2 (CoW): CowOnewayBitset, snapshots share the chunks (4 kB) with the live mask,
+//            which clones a chunk on the first write after a snapshot
+// For both we also time the operations on the live mask alone (random set, count, merge),
+// to see what the chunking costs when there are no snapshots.
+//
+// The following settings are configured:
+// 5 runs per benchmark, 1 GBit mask (125 MB), 100 steps per run with 1000 random sets each,
+// the last 10 snapshots are kept.
+//
+// Expectation: A copy costs a pass over 125 MB per step (plus page faults for fresh
+// memory), while the CoW snapshot copies 30k chunk pointers and every step clones at most
+// 1000 chunks (4 MB), so it should be faster by one to two orders of magnitude. Random
+// set() costs an extra indirection (the chunk directory), count() and merge() should be
+// about as fast as for OnewayBitset, because they run the same kernels chunk by chunk.
+// Result (1 GBit, AVX-512 machine): a step with snapshot takes 1.2 ms with CoW versus 15.6 ms
+// with copies (13x), with about 1000 cloned chunks per step (3% of the mask). The CoW step is
+// dominated by the 1000 clones, i.e. as expected proportional to the modified chunks. With
+// 100 MBit (3k chunks), the sets of a step touch a third of the chunks, and CoW only wins 3x.
+// Without snapshots, random set() is 2x slower than for OnewayBitset, count() and merge()
+// take 1.25x as long.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using CopyBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+using CowBF = CowOnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000000.; // microseconds
+    std::cout << label << ":" << std::setw(std::max(1, 30-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " microseconds" << std::endl;
+}
+
+template <class BF>
+void run_benchmarks(const std::string &label, const BenchSizeT nbits, const int nsteps, const BenchSizeT nsets, const size_t nkeep, const BenchSizeT naccess, const int nruns)
+{
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t/step ( snapshot, " + label + " )", sample_benchmark([&] {
+        BF live(nbits);
+        std::vector<BF> snapshots(nkeep, BF(nbits));
+        uint64_t state = 1337;
+        timer.reset();
+        for (int step=0; step<nsteps; ++step) {
+            for (BenchSizeT k=0; k<nsets; ++k) {
+                state = state*6364136223846793005ULL + 1442695040888963407ULL;
+                live.set((state >> 16) % nbits);
+            }
+            snapshots[static_cast<size_t>(step) % nkeep] = live; // the old snapshot is destroyed
+        }
+        const double time = timer.elapsed();
+        sink += snapshots[0].count();
+        return time/nsteps;
+    }, nruns));
+
+    BF bitset1(nbits), bitset2(nbits);
+    print_result("t/set ( random set, " + label + " )", sample_benchmark([&] {
+        uint64_t state = 4242;
+        timer.reset();
+        for (BenchSizeT k=0; k<naccess; ++k) {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            bitset1.set((state >> 16) % nbits);
+        }
+        return timer.elapsed()/naccess;
+    }, nruns));
+
+    for (BenchSizeT i=0; i<nbits; i+=3) { bitset2.set(i); }
+    print_result("t ( count, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += bitset2.count();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( merge, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset1.merge(bitset2);
+        return timer.elapsed();
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl << std::endl;
+}
+
+void count_cloned_chunks(const BenchSizeT nbits, const int nsteps, const BenchSizeT nsets)
+{   // average number of chunks cloned per step, i.e. the memory cost of a CoW snapshot
+    CowBF live(nbits), snapshot(nbits);
+    uint64_t state = 1337;
+    size_t ncloned = 0;
+    for (int step=0; step<nsteps; ++step) {
+        snapshot = live;
+        for (BenchSizeT k=0; k<nsets; ++k) {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            live.set((state >> 16) % nbits);
+        }
+        ncloned += live.getNAllocatedChunks() - live.getNSharedChunks();
+    }
+    std::cout << "cloned chunks per step (CoW): " << static_cast<double>(ncloned)/nsteps << " of " << live.getNChunks() << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 1000000000UL;
+    const int nsteps = 100;
+    const BenchSizeT nsets = 1000;
+    const size_t nkeep = 10;
+    const BenchSizeT naccess = 10000000UL;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    run_benchmarks<CopyBF>("copy", nbits, nsteps, nsets, nkeep, naccess, nruns);
+    run_benchmarks<CowBF>("CoW", nbits, nsteps, nsets, nkeep, naccess, nruns);
+    count_cloned_chunks(nbits, nsteps, nsets);
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "OnewayBitset.hpp"
+#include "storage.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of the storage policies on the huge bitset operations of test.cpp
+//
+// We compare the following approaches:
+// Approach 1 (Heap): OnewayBitset with the default HeapStorage (new[])
+// Approach 2 (Aligned): AlignedStorage<64>, i.e. blocks aligned to cache lines
+// Approach 3 (Huge pages): HugePageStorage, i.e. 2 MB aligned anonymous memory with MADV_HUGEPAGE
+//
+// For each we time the operations of the "20 GBit" part of test.cpp (construction, strided set,
+// count, merge, reset) and additionally random set() and get(), which are dominated by TLB misses.
+//
+// The following settings are configured:
+// 5 runs per benchmark, two 10 GBit bitsets (1.25 GB each), 10^7 random accesses.
+//
+// Expectation: Alignment should hardly matter, because with 16 byte aligned new[] memory
+// only every other 64 byte vector load is split, which modern cores handle well. Huge pages
+// should speed up random access a lot (2.5 GB need 640k TLB entries with 4 kB pages, but only
+// 1280 with 2 MB pages), and construction, because zeroing is left to the kernel, which
+// faults in 2 MB at a time.
+// Result (10 GBit, AVX-512 machine, THP in "madvise" mode, two runs): alignment hardly matters,
+// aligned count is 5-25% faster than heap, merge and reset are within the run-to-run noise (10-15%
+// on this VM). Construction with huge pages is almost free (0.3 vs 520 ms), but only because the
+// kernel faults in the pages later (the first setStrided pays, it is 5% slower). count and reset
+// with huge pages are as fast as aligned (the huge pages are 2 MB aligned, too), merge is 20%
+// slower. Random set()/get() are 1.3x faster with huge pages (120 vs 157 ms) in the run where all
+// 2.4 GB were backed by huge pages, but in the other run they were 1.2x slower with a large spread.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+
+
+void print_result(const std::string &label, const std::pair<double, double> &result)
+{
+    const double time_scale = 1000.; // milliseconds
+    std::cout << label << ":" << std::setw(std::max(1, 36-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << " milliseconds" << std::endl;
+}
+
+template <class StorageT>
+void run_benchmarks(const std::string &label, const BenchSizeT nbits, const BenchSizeT naccess, const int nruns)
+{
+    using BF = OnewayBitset<BenchSizeT, BenchAllocT, onewayopt::none, StorageT>;
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+
+    print_result("t ( construct, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        BF bitset(nbits);
+        bitset.set(nbits-1); // make sure that the last page is faulted in
+        const double time = timer.elapsed();
+        sink += bitset.count();
+        return time;
+    }, nruns));
+
+    BF bitset1(nbits), bitset2(nbits);
+    print_result("t ( setStrided, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset1.setStrided(0, 3);
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( count, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += bitset1.count();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( merge, " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset2.merge(bitset1);
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( reset, " + label + " )", sample_benchmark([&] {
+        bitset2.set(0);
+        timer.reset();
+        bitset2.reset();
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( random set, " + label + " )", sample_benchmark([&] {
+        uint64_t state = 1337;
+        timer.reset();
+        for (BenchSizeT k=0; k<naccess; ++k) {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            bitset2.set((state >> 16) % nbits);
+        }
+        return timer.elapsed();
+    }, nruns));
+
+    print_result("t ( random get, " + label + " )", sample_benchmark([&] {
+        uint64_t state = 4242;
+        timer.reset();
+        for (BenchSizeT k=0; k<naccess; ++k) {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            sink += bitset2.get((state >> 16) % nbits);
+        }
+        return timer.elapsed();
+    }, nruns));
+
+    std::cout << "(checksum " << sink << ")" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+    const BenchSizeT nbits = 10000000000UL;
+    const BenchSizeT naccess = 10000000UL;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    run_benchmarks<HeapStorage>("heap", nbits, naccess, nruns);
+    run_benchmarks<AlignedStorage<64>>("aligned", nbits, naccess, nruns);
+    run_benchmarks<HugePageStorage>("huge pages", nbits, naccess, nruns);
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include "OnewayBitset.hpp"
+#include "blockkernels.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of the streaming option for bitsets much larger than the caches
+//
+// The full scans (count, all, equals, getAll) and fills (reset, setAll) of a huge bitset can at
+// best run at memory bandwidth. We measure a STREAM-like peak on the same memory first:
+// read = sum over a uint64_t array (vectorized), write = the better of std::fill and a fill with
+// non-temporal stores. Then we report the bandwidth of every operation as a fraction of the
+// matching peak (getAll writes 8 bytes per bitset byte, so it is compared to the write peak).
+//
+// We compare the following approaches:
+// Approach 1 (Plain): OnewayBitset
+// Approach 2 (Streaming): OnewayBitset with onewayopt::streaming, i.e. software prefetch
+//            (into L2) ahead of the scan kernels and non-temporal stores for fills
+// Before that, count() of the streaming bitset is timed for several prefetch distances
+// (blockkernels::streamPrefetchDistance), to tune the default.
+// Finally, we time a pass over a small working set (4 MB, fits into L3) right after a reset of
+// the big bitset, to see whether the fill evicted it from the caches.
+//
+// The following settings are configured:
+// 10 runs per benchmark, 4 GBit (512 MB) bitsets, and 256 MBit for getAll (256 MB of bools).
+//
+// Expectation: The hardware prefetchers already detect these linear streams, so software
+// prefetch can only help by getting further ahead (e.g. across 4 kB pages, where the hardware
+// prefetchers stop). Non-temporal stores save the read-for-ownership of every line, i.e. a
+// fill moves half the traffic, and they bypass the caches, so the working set should survive.
+// Result (1 core VM, AVX-512): the peaks are 16 GB/s read and 23 GB/s write (non-temporal, std::fill
+// only reaches 10 GB/s). Plain all() and equals() already run at the read peak, plain count() at
+// 88%, which prefetching lifts to 100% for distances from 2 kB to 32 kB (4 kB is the default).
+// A non-temporal prefetch hint (prefetchnta) instead halved the bandwidth of count(), so we
+// prefetch into L2. The non-temporal fills are where the option pays off most: reset/setAll take
+// half the time (98-102% of the write peak vs 50%), and a 4 MB working set is read at its cached
+// speed right after a reset (29 GB/s), instead of 1.5x slower (20 GB/s) after a regular fill.
+// getAll stays at about a third of the write peak either way, i.e. at the std::fill speed of the
+// bool array it writes, which the prefetch of its input doesn't change.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using PlainBF = OnewayBitset<BenchSizeT, BenchAllocT>;
+using StreamingBF = OnewayBitset<BenchSizeT, BenchAllocT, onewayopt::streaming>;
+
+
+void print_bandwidth(const std::string &label, const std::pair<double, double> &result, const double nbytes, const double peak = 0.)
+{   // result is a time in seconds
+    const double gbps = nbytes/result.first*1e-9;
+    std::cout << label << ":" << std::setw(std::max(1, 40-static_cast<int>(label.length()))) << std::setfill(' ') << " "
+              << result.first*1000. << " +- " << result.second*1000. << " ms, " << gbps << " GB/s";
+    if (peak > 0.) { std::cout << " (" << static_cast<int>(100.*gbps/peak + 0.5) << "% of peak)"; }
+    std::cout << std::endl;
+}
+
+template <class BF>
+void run_benchmarks(const std::string &label, const BenchSizeT nbits, const BenchSizeT nbitsGetAll, const double readPeak, const double writePeak, const int nruns)
+{
+    Timer timer(1.);
+    BenchSizeT sink = 0;
+    const double nbytes = static_cast<double>(nbits/8);
+
+    BF bitset1(nbits), bitset2(nbits);
+    for (BenchSizeT i=0; i<nbits; i+=3) { bitset2.set(i); }
+
+    print_bandwidth("setAll ( " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset1.setAll();
+        return timer.elapsed();
+    }, nruns), nbytes, writePeak);
+
+    print_bandwidth("all ( " + label + " )", sample_benchmark([&] { // all ones, i.e. a full scan
+        timer.reset();
+        sink += bitset1.all() ? 1 : 0;
+        return timer.elapsed();
+    }, nruns), nbytes, readPeak);
+
+    print_bandwidth("count ( " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        sink += bitset2.count();
+        return timer.elapsed();
+    }, nruns), nbytes, readPeak);
+
+    bitset1.reset();
+    bitset1.merge(bitset2);
+    print_bandwidth("equals ( " + label + " )", sample_benchmark([&] { // equal, i.e. a full scan of both
+        timer.reset();
+        sink += (bitset1 == bitset2) ? 1 : 0;
+        return timer.elapsed();
+    }, nruns), 2.*nbytes, readPeak);
+
+    print_bandwidth("reset ( " + label + " )", sample_benchmark([&] {
+        bitset1.set(0); // so that reset() has to fill
+        timer.reset();
+        bitset1.reset();
+        return timer.elapsed();
+    }, nruns), nbytes, writePeak);
+
+    { // working set pass after a reset of the big bitset
+        std::vector<uint64_t> work(4*1024*1024/sizeof(uint64_t), 1);
+        auto sumWork = [&work]() { uint64_t sum = 0; for (const auto w : work) { sum += w; } return sum; };
+        print_bandwidth("work after reset ( " + label + " )", sample_benchmark([&] {
+            sink += sumWork(); // make it cache resident
+            bitset1.set(0);
+            bitset1.reset();
+            timer.reset();
+            sink += sumWork();
+            return timer.elapsed();
+        }, nruns), static_cast<double>(work.size()*sizeof(uint64_t)));
+        print_bandwidth("work, no reset ( " + label + " )", sample_benchmark([&] {
+            sink += sumWork();
+            timer.reset();
+            sink += sumWork();
+            return timer.elapsed();
+        }, nruns), static_cast<double>(work.size()*sizeof(uint64_t)));
+    }
+
+    BF bitset3(nbitsGetAll);
+    for (BenchSizeT i=0; i<nbitsGetAll; i+=3) { bitset3.set(i); }
+    std::unique_ptr<bool[]> out(new bool[nbitsGetAll]);
+    std::fill(out.get(), out.get()+nbitsGetAll, false); // page it in
+    print_bandwidth("getAll ( " + label + " )", sample_benchmark([&] {
+        timer.reset();
+        bitset3.getAll(out.get());
+        return timer.elapsed();
+    }, nruns), static_cast<double>(nbitsGetAll), writePeak); // counting the bool bytes written
+    sink += out[nbitsGetAll-1] ? 1 : 0;
+
+    std::cout << "(checksum " << sink << ")" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 10;
+    const BenchSizeT nbits = BenchSizeT(1) << 32; // 512 MB
+    const BenchSizeT nbitsGetAll = BenchSizeT(1) << 28; // 256 MB of bools
+    const size_t distances[] = {0, 1024, 2048, 4096, 8192, 16384, 32768};
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (" << nbits << " bits):" << std::endl << std::endl;
+
+    Timer timer(1.);
+    const size_t nwords = static_cast<size_t>(nbits/64);
+    const double nbytes = static_cast<double>(nwords*sizeof(uint64_t));
+    std::vector<uint64_t> words(nwords, 3);
+    uint64_t sink = 0;
+
+    const auto readPeak = sample_benchmark([&] {
+        timer.reset();
+        uint64_t sum = 0;
+        for (size_t i=0; i<nwords; ++i) { sum += words[i]; }
+        sink += sum;
+        return timer.elapsed();
+    }, nruns);
+    const auto fillPeak = sample_benchmark([&] {
+        timer.reset();
+        std::fill(words.begin(), words.end(), sink);
+        return timer.elapsed();
+    }, nruns);
+    const auto fillStreamPeak = sample_benchmark([&] {
+        timer.reset();
+        blockkernels::fillStream(reinterpret_cast<unsigned char *>(words.data()), static_cast<unsigned char>(sink), nwords*sizeof(uint64_t));
+        return timer.elapsed();
+    }, nruns);
+    print_bandwidth("peak read ( sum )", readPeak, nbytes);
+    print_bandwidth("peak write ( std::fill )", fillPeak, nbytes);
+    print_bandwidth("peak write ( non-temporal )", fillStreamPeak, nbytes);
+    const double readPeakGBps = nbytes/readPeak.first*1e-9;
+    const double writePeakGBps = nbytes/std::min(fillPeak.first, fillStreamPeak.first)*1e-9;
+    std::cout << std::endl;
+    words = std::vector<uint64_t>(); // release it
+
+    { // prefetch distance sweep
+        StreamingBF bitset(nbits);
+        for (BenchSizeT i=0; i<nbits; i+=3) { bitset.set(i); }
+        const size_t defaultDistance = blockkernels::streamPrefetchDistance();
+        for (const size_t distance : distances) {
+            blockkernels::streamPrefetchDistance() = distance;
+            print_bandwidth("count ( prefetch " + std::to_string(distance) + " bytes )", sample_benchmark([&] {
+                timer.reset();
+                sink += bitset.count();
+                return timer.elapsed();
+            }, nruns), static_cast<double>(nbits/8), readPeakGBps);
+        }
+        blockkernels::streamPrefetchDistance() = defaultDistance;
+        std::cout << std::endl;
+    }
+
+    run_benchmarks<PlainBF>("plain", nbits, nbitsGetAll, readPeakGBps, writePeakGBps, nruns);
+    run_benchmarks<StreamingBF>("streaming", nbits, nbitsGetAll, readPeakGBps, writePeakGBps, nruns);
+
+    std::cout << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+
+    return 0;
+}
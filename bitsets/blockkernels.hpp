@@ -0,0 +1,889 @@
+/* Block kernels for OnewayBitset
+   Author: Jan Kessler (2019)
+
+   Bulk operations on raw bitset memory (OR-merge/assign of one or many sources, with
+   or without popcount of the result, compare,
+   all-ones check, popcount, fused binary-op popcount/any, expansion to bool bytes,
+   search for the first non-zero byte, non-temporal fill),
+   working on plain byte ranges so that they don't care whether the bitset uses
+   uint8_t or uint64_t blocks. On x86 with GCC/Clang we compile AVX2 and AVX-512
+   versions via target attributes (i.e. independent of -march) and pick the best
+   one supported by the CPU at runtime. Everywhere else only the scalar fallback
+   (working on 64 bit words) is used.
+
+   The AVX2/AVX-512BW popcount is the nibble-lookup method from:
+   1) W. Mula, N. Kurz, D. Lemire, "Faster Population Counts Using AVX2 Instructions" (2016)
+
+   The *Stream entry points are for ranges much larger than the caches: they run the
+   kernels chunk by chunk and prefetch (into L2) a tunable distance ahead, and
+   fillStream writes with non-temporal stores, i.e. past the caches.
+
+   The bit-to-byte expansion assumes little endian byte order (bit i of the range in
+   byte i/8), as does the rest of the code using it.
+*/
+
+#ifndef BLOCK_KERNELS_HPP
+#define BLOCK_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOCK_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace blockkernels
+{
+
+// --- Word helpers
+
+inline uint64_t load64(const unsigned char * p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+inline void store64(unsigned char * p, const uint64_t v) { std::memcpy(p, &v, sizeof(v)); }
+
+inline unsigned popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcountll(v));
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+inline unsigned ctz64(uint64_t v) // index of lowest set bit, pass v != 0
+{
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#else
+    unsigned n = 0;
+    while (!(v & 1)) { v >>= 1; ++n; }
+    return n;
+#endif
+}
+
+
+// --- Scalar fallback (64 bit words, then remaining bytes)
+
+inline void orIntoScalar(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { store64(dst+i, load64(dst+i) | load64(src+i)); }
+    for (; i<nbytes; ++i) { dst[i] |= src[i]; }
+}
+
+inline uint64_t orIntoCountScalar(unsigned char * dst, const unsigned char * src, const size_t nbytes) // returns popcount(dst)
+{
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) {
+        const uint64_t v = load64(dst+i) | load64(src+i);
+        store64(dst+i, v);
+        count += popcount64(v);
+    }
+    for (; i<nbytes; ++i) { dst[i] |= src[i]; count += popcount64(dst[i]); }
+    return count;
+}
+
+template <bool Accumulate>
+inline void orManyScalar(unsigned char * dst, const unsigned char * const * srcs, const size_t nsrcs, const size_t nbytes)
+{   // dst (|)= srcs[0] | srcs[1] | ..., every dst word is written once (and read once if Accumulate)
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) {
+        uint64_t acc = Accumulate ? load64(dst+i) : uint64_t(0);
+        for (size_t s=0; s<nsrcs; ++s) { acc |= load64(srcs[s]+i); }
+        store64(dst+i, acc);
+    }
+    for (; i<nbytes; ++i) {
+        unsigned char acc = Accumulate ? dst[i] : 0;
+        for (size_t s=0; s<nsrcs; ++s) { acc |= srcs[s][i]; }
+        dst[i] = acc;
+    }
+}
+
+inline bool equalScalar(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    return (nbytes == 0 || std::memcmp(a, b, nbytes) == 0); // libc memcmp is vectorized already (but must not get null pointers)
+}
+
+inline bool allOnesScalar(const unsigned char * a, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { if (load64(a+i) != ~uint64_t(0)) { return false; } }
+    for (; i<nbytes; ++i) { if (a[i] != 0xFF) { return false; } }
+    return true;
+}
+
+inline uint64_t popcountScalar(const unsigned char * a, const size_t nbytes)
+{
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { count += popcount64(load64(a+i)); }
+    for (; i<nbytes; ++i) { count += popcount64(a[i]); }
+    return count;
+}
+
+enum class BinOp { and_, or_, andnot }; // andnot: a & ~b
+
+template <BinOp op>
+inline uint64_t applyOp(const uint64_t a, const uint64_t b)
+{
+    return (op == BinOp::and_) ? (a & b) : (op == BinOp::or_) ? (a | b) : (a & ~b);
+}
+
+template <BinOp op>
+inline uint64_t popcountOpScalar(const unsigned char * a, const unsigned char * b, const size_t nbytes) // popcount(a op b)
+{
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { count += popcount64(applyOp<op>(load64(a+i), load64(b+i))); }
+    for (; i<nbytes; ++i) { count += popcount64(applyOp<op>(a[i], b[i]) & 0xFF); }
+    return count;
+}
+
+template <BinOp op>
+inline bool anyOpScalar(const unsigned char * a, const unsigned char * b, const size_t nbytes) // (a op b) != 0
+{
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { if (applyOp<op>(load64(a+i), load64(b+i))) { return true; } }
+    for (; i<nbytes; ++i) { if (applyOp<op>(a[i], b[i]) & 0xFF) { return true; } }
+    return false;
+}
+
+inline uint64_t expandByte(const unsigned char byte) // bit i of byte -> byte i of result (0 or 1)
+{
+    const uint64_t spread = (byte * 0x0101010101010101ULL) & 0x8040201008040201ULL; // byte i keeps bit i
+    return ((spread + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL; // any bit set in byte -> 1 (no carries)
+}
+
+inline void expandBitsScalar(const unsigned char * a, unsigned char * out, const size_t nbytes) // out[8*nbytes]
+{
+    for (size_t i=0; i<nbytes; ++i) { store64(out+8*i, expandByte(a[i])); }
+}
+
+inline void fillStreamScalar(unsigned char * dst, const unsigned char value, const size_t nbytes) { std::memset(dst, value, nbytes); }
+
+inline size_t findNonzeroScalar(const unsigned char * a, const size_t nbytes) // offset of first non-zero byte, or nbytes
+{
+    size_t i = 0;
+    while (i+8<=nbytes && load64(a+i) == 0) { i+=8; }
+    while (i<nbytes && a[i] == 0) { ++i; }
+    return i;
+}
+
+
+#ifdef BLOCK_KERNELS_X86
+
+// --- AVX2 (256 bit lanes)
+
+__attribute__((target("avx2")))
+inline void orIntoAVX2(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) { // 4 lanes per iteration, to keep enough loads in flight
+        for (size_t j=0; j<128; j+=32) {
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst+i+j));
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src+i+j));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i+j), _mm256_or_si256(d, s));
+        }
+    }
+    for (; i+32<=nbytes; i+=32) {
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst+i));
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src+i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), _mm256_or_si256(d, s));
+    }
+    orIntoScalar(dst+i, src+i, nbytes-i);
+}
+
+template <bool Accumulate>
+__attribute__((target("avx2")))
+inline void orManyAVX2(unsigned char * dst, const unsigned char * const * srcs, const size_t nsrcs, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) { // 4 lanes of dst stay in registers while all sources stream by
+        __m256i acc[4];
+        for (size_t j=0; j<4; ++j) { acc[j] = Accumulate ? _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst+i+32*j)) : _mm256_setzero_si256(); }
+        for (size_t s=0; s<nsrcs; ++s) {
+            for (size_t j=0; j<4; ++j) { acc[j] = _mm256_or_si256(acc[j], _mm256_loadu_si256(reinterpret_cast<const __m256i *>(srcs[s]+i+32*j))); }
+        }
+        for (size_t j=0; j<4; ++j) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i+32*j), acc[j]); }
+    }
+    if (!Accumulate && i < nbytes) { std::memset(dst+i, 0, nbytes-i); }
+    for (size_t s=0; s<nsrcs; ++s) { orIntoAVX2(dst+i, srcs[s]+i, nbytes-i); }
+}
+
+__attribute__((target("avx2")))
+inline bool equalAVX2(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) {
+        __m256i diff = _mm256_setzero_si256();
+        for (size_t j=0; j<128; j+=32) {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+j));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b+i+j));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(va, vb));
+        }
+        if (!_mm256_testz_si256(diff, diff)) { return false; }
+    }
+    for (; i+32<=nbytes; i+=32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b+i));
+        const __m256i diff = _mm256_xor_si256(va, vb);
+        if (!_mm256_testz_si256(diff, diff)) { return false; }
+    }
+    return equalScalar(a+i, b+i, nbytes-i);
+}
+
+__attribute__((target("avx2")))
+inline bool allOnesAVX2(const unsigned char * a, const size_t nbytes)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) {
+        __m256i acc = ones;
+        for (size_t j=0; j<128; j+=32) {
+            acc = _mm256_and_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+j)));
+        }
+        if (!_mm256_testc_si256(acc, ones)) { return false; } // testc: (~acc & ones) == 0
+    }
+    for (; i+32<=nbytes; i+=32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i));
+        if (!_mm256_testc_si256(va, ones)) { return false; }
+    }
+    return allOnesScalar(a+i, nbytes-i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i popcountBytesAVX2(const __m256i v) // per-byte popcounts via nibble lookup
+{
+    const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                            0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i lo = _mm256_and_si256(v, low_mask);
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+}
+
+__attribute__((target("avx2")))
+inline uint64_t popcountAVX2(const unsigned char * a, const size_t nbytes)
+{
+    __m256i total = _mm256_setzero_si256(); // 4 x 64 bit partial sums
+    size_t i = 0;
+    while (i+32<=nbytes) {
+        // byte counters may hold at most 255, i.e. 31 lanes of 8 bits each
+        __m256i local = _mm256_setzero_si256();
+        for (int k=0; k<31 && i+32<=nbytes; ++k, i+=32) {
+            local = _mm256_add_epi8(local, popcountBytesAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i))));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    uint64_t count = static_cast<uint64_t>(_mm256_extract_epi64(total, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 1))
+                   + static_cast<uint64_t>(_mm256_extract_epi64(total, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 3));
+    return count + popcountScalar(a+i, nbytes-i);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t orIntoCountAVX2(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i+32<=nbytes) {
+        __m256i local = _mm256_setzero_si256(); // byte counters, see popcountAVX2
+        for (int k=0; k<31 && i+32<=nbytes; ++k, i+=32) {
+            const __m256i v = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst+i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src+i)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst+i), v);
+            local = _mm256_add_epi8(local, popcountBytesAVX2(v));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    uint64_t count = static_cast<uint64_t>(_mm256_extract_epi64(total, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 1))
+                   + static_cast<uint64_t>(_mm256_extract_epi64(total, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 3));
+    return count + orIntoCountScalar(dst+i, src+i, nbytes-i);
+}
+
+__attribute__((target("avx2")))
+inline size_t findNonzeroAVX2(const unsigned char * a, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) { // OR 4 lanes, to test a whole 128 byte stretch at once
+        const __m256i acc = _mm256_or_si256(
+            _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+32))),
+            _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+64)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+96))));
+        if (!_mm256_testz_si256(acc, acc)) { break; }
+    }
+    for (; i+32<=nbytes; i+=32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i));
+        const unsigned zeros = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, _mm256_setzero_si256())));
+        if (zeros != 0xFFFFFFFFu) { return i + ctz64(~zeros); }
+    }
+    return i + findNonzeroScalar(a+i, nbytes-i);
+}
+
+__attribute__((target("avx2")))
+inline void expandBitsAVX2(const unsigned char * a, unsigned char * out, const size_t nbytes)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,
+                                             2,2,2,2,2,2,2,2,3,3,3,3,3,3,3,3); // byte k to bytes 8k..8k+7
+    const __m256i bitmask = _mm256_set1_epi64x(static_cast<long long>(0x8040201008040201ULL));
+    const __m256i one = _mm256_set1_epi8(1);
+    size_t i = 0;
+    for (; i+4<=nbytes; i+=4) {
+        uint32_t bits;
+        std::memcpy(&bits, a+i, sizeof(bits));
+        const __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits)), shuffle);
+        const __m256i isset = _mm256_cmpeq_epi8(_mm256_and_si256(spread, bitmask), bitmask); // 0xFF or 0
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out+8*i), _mm256_and_si256(isset, one));
+    }
+    expandBitsScalar(a+i, out+8*i, nbytes-i);
+}
+
+
+template <BinOp op>
+__attribute__((target("avx2")))
+inline __m256i applyOpAVX2(const __m256i a, const __m256i b)
+{
+    return (op == BinOp::and_) ? _mm256_and_si256(a, b) : (op == BinOp::or_) ? _mm256_or_si256(a, b) : _mm256_andnot_si256(b, a);
+}
+
+template <BinOp op>
+__attribute__((target("avx2")))
+inline uint64_t popcountOpAVX2(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i+32<=nbytes) {
+        __m256i local = _mm256_setzero_si256();
+        for (int k=0; k<31 && i+32<=nbytes; ++k, i+=32) {
+            const __m256i v = applyOpAVX2<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b+i)));
+            local = _mm256_add_epi8(local, popcountBytesAVX2(v));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    uint64_t count = static_cast<uint64_t>(_mm256_extract_epi64(total, 0)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 1))
+                   + static_cast<uint64_t>(_mm256_extract_epi64(total, 2)) + static_cast<uint64_t>(_mm256_extract_epi64(total, 3));
+    return count + popcountOpScalar<op>(a+i, b+i, nbytes-i);
+}
+
+template <BinOp op>
+__attribute__((target("avx2")))
+inline bool anyOpAVX2(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+128<=nbytes; i+=128) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t j=0; j<128; j+=32) {
+            acc = _mm256_or_si256(acc, applyOpAVX2<op>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a+i+j)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b+i+j))));
+        }
+        if (!_mm256_testz_si256(acc, acc)) { return true; }
+    }
+    return anyOpScalar<op>(a+i, b+i, nbytes-i);
+}
+
+
+__attribute__((target("avx2")))
+inline void fillStreamAVX2(unsigned char * dst, const unsigned char value, const size_t nbytes) // non-temporal stores
+{
+    const size_t head = std::min(nbytes, (32 - reinterpret_cast<uintptr_t>(dst) % 32) % 32); // streaming stores must be aligned
+    std::memset(dst, value, head);
+    const __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+    size_t i = head;
+    for (; i+32<=nbytes; i+=32) { _mm256_stream_si256(reinterpret_cast<__m256i *>(dst+i), v); }
+    _mm_sfence(); // order them before later (regular) stores
+    std::memset(dst+i, value, nbytes-i);
+}
+
+// --- AVX-512 (512 bit lanes, requires F+BW)
+
+__attribute__((target("avx512f,avx512bw")))
+inline void orIntoAVX512(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        for (size_t j=0; j<256; j+=64) {
+            const __m512i d = _mm512_loadu_si512(dst+i+j);
+            const __m512i s = _mm512_loadu_si512(src+i+j);
+            _mm512_storeu_si512(dst+i+j, _mm512_or_si512(d, s));
+        }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        _mm512_storeu_si512(dst+i, _mm512_or_si512(_mm512_loadu_si512(dst+i), _mm512_loadu_si512(src+i)));
+    }
+    if (i < nbytes) { // masked tail, no scalar loop needed
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        const __m512i d = _mm512_maskz_loadu_epi8(m, dst+i);
+        const __m512i s = _mm512_maskz_loadu_epi8(m, src+i);
+        _mm512_mask_storeu_epi8(dst+i, m, _mm512_or_si512(d, s));
+    }
+}
+
+template <bool Accumulate>
+__attribute__((target("avx512f,avx512bw")))
+inline void orManyAVX512(unsigned char * dst, const unsigned char * const * srcs, const size_t nsrcs, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        __m512i acc[4];
+        for (size_t j=0; j<4; ++j) { acc[j] = Accumulate ? _mm512_loadu_si512(dst+i+64*j) : _mm512_setzero_si512(); }
+        for (size_t s=0; s<nsrcs; ++s) {
+            for (size_t j=0; j<4; ++j) { acc[j] = _mm512_or_si512(acc[j], _mm512_loadu_si512(srcs[s]+i+64*j)); }
+        }
+        for (size_t j=0; j<4; ++j) { _mm512_storeu_si512(dst+i+64*j, acc[j]); }
+    }
+    if (!Accumulate && i < nbytes) { std::memset(dst+i, 0, nbytes-i); }
+    for (size_t s=0; s<nsrcs; ++s) { orIntoAVX512(dst+i, srcs[s]+i, nbytes-i); }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline bool equalAVX512(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        __m512i diff = _mm512_setzero_si512();
+        for (size_t j=0; j<256; j+=64) {
+            diff = _mm512_or_si512(diff, _mm512_xor_si512(_mm512_loadu_si512(a+i+j), _mm512_loadu_si512(b+i+j)));
+        }
+        if (_mm512_test_epi64_mask(diff, diff)) { return false; }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(a+i), _mm512_loadu_si512(b+i))) { return false; }
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        if (_mm512_cmpneq_epi8_mask(_mm512_maskz_loadu_epi8(m, a+i), _mm512_maskz_loadu_epi8(m, b+i))) { return false; }
+    }
+    return true;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline bool allOnesAVX512(const unsigned char * a, const size_t nbytes)
+{
+    const __m512i ones = _mm512_set1_epi8(-1);
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        __m512i acc = ones;
+        for (size_t j=0; j<256; j+=64) {
+            acc = _mm512_and_si512(acc, _mm512_loadu_si512(a+i+j));
+        }
+        if (_mm512_cmpneq_epi64_mask(acc, ones)) { return false; }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(a+i), ones)) { return false; }
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        if (_mm512_mask_cmpneq_epi8_mask(m, _mm512_maskz_loadu_epi8(m, a+i), ones)) { return false; }
+    }
+    return true;
+}
+
+__attribute__((target("avx512f")))
+inline uint64_t hsumAVX512(const __m512i v) // horizontal sum of 8 x 64 bit
+{
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, v);
+    return lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7];
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline __m512i popcountBytesAVX512(const __m512i v)
+{
+    const __m512i lookup = _mm512_set4_epi32(0x04030302, 0x03020201, 0x03020201, 0x02010100); // 0,1,1,2,1,2,2,3,...
+    const __m512i low_mask = _mm512_set1_epi8(0x0f);
+    const __m512i lo = _mm512_and_si512(v, low_mask);
+    const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_mask);
+    return _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo), _mm512_shuffle_epi8(lookup, hi));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline uint64_t popcountAVX512(const unsigned char * a, const size_t nbytes)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    while (i+64<=nbytes) {
+        __m512i local = _mm512_setzero_si512();
+        for (int k=0; k<31 && i+64<=nbytes; ++k, i+=64) {
+            local = _mm512_add_epi8(local, popcountBytesAVX512(_mm512_loadu_si512(a+i)));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(local, _mm512_setzero_si512()));
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(popcountBytesAVX512(_mm512_maskz_loadu_epi8(m, a+i)), _mm512_setzero_si512()));
+    }
+    return hsumAVX512(total);
+}
+
+template <BinOp op>
+__attribute__((target("avx512f,avx512bw")))
+inline __m512i applyOpAVX512(const __m512i a, const __m512i b)
+{
+    return (op == BinOp::and_) ? _mm512_and_si512(a, b) : (op == BinOp::or_) ? _mm512_or_si512(a, b) : _mm512_and_si512(a, _mm512_xor_si512(b, _mm512_set1_epi64(-1))); // (not _mm512_andnot_si512, which makes GCC warn)
+}
+
+template <BinOp op>
+__attribute__((target("avx512f,avx512bw")))
+inline uint64_t popcountOpAVX512(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    while (i+64<=nbytes) {
+        __m512i local = _mm512_setzero_si512();
+        for (int k=0; k<31 && i+64<=nbytes; ++k, i+=64) {
+            local = _mm512_add_epi8(local, popcountBytesAVX512(applyOpAVX512<op>(_mm512_loadu_si512(a+i), _mm512_loadu_si512(b+i))));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(local, _mm512_setzero_si512()));
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        const __m512i v = applyOpAVX512<op>(_mm512_maskz_loadu_epi8(m, a+i), _mm512_maskz_loadu_epi8(m, b+i));
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(popcountBytesAVX512(v), _mm512_setzero_si512()));
+    }
+    return hsumAVX512(total);
+}
+
+template <BinOp op>
+__attribute__((target("avx512f,avx512bw")))
+inline bool anyOpAVX512(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        __m512i acc = _mm512_setzero_si512();
+        for (size_t j=0; j<256; j+=64) {
+            acc = _mm512_or_si512(acc, applyOpAVX512<op>(_mm512_loadu_si512(a+i+j), _mm512_loadu_si512(b+i+j)));
+        }
+        if (_mm512_test_epi64_mask(acc, acc)) { return true; }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        const __m512i v = applyOpAVX512<op>(_mm512_loadu_si512(a+i), _mm512_loadu_si512(b+i));
+        if (_mm512_test_epi64_mask(v, v)) { return true; }
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        const __m512i v = applyOpAVX512<op>(_mm512_maskz_loadu_epi8(m, a+i), _mm512_maskz_loadu_epi8(m, b+i));
+        if (_mm512_test_epi64_mask(v, v)) { return true; }
+    }
+    return false;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vpopcntdq")))
+inline uint64_t popcountAVX512VPOPCNT(const unsigned char * a, const size_t nbytes)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        for (size_t j=0; j<256; j+=64) {
+            total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(a+i+j)));
+        }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512(a+i)));
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi8(m, a+i)));
+    }
+    return hsumAVX512(total);
+}
+__attribute__((target("avx512f,avx512bw")))
+inline uint64_t orIntoCountAVX512(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    while (i+64<=nbytes) {
+        __m512i local = _mm512_setzero_si512(); // byte counters, see popcountAVX512
+        for (int k=0; k<31 && i+64<=nbytes; ++k, i+=64) {
+            const __m512i v = _mm512_or_si512(_mm512_loadu_si512(dst+i), _mm512_loadu_si512(src+i));
+            _mm512_storeu_si512(dst+i, v);
+            local = _mm512_add_epi8(local, popcountBytesAVX512(v));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(local, _mm512_setzero_si512()));
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        const __m512i v = _mm512_or_si512(_mm512_maskz_loadu_epi8(m, dst+i), _mm512_maskz_loadu_epi8(m, src+i));
+        _mm512_mask_storeu_epi8(dst+i, m, v);
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(popcountBytesAVX512(v), _mm512_setzero_si512()));
+    }
+    return hsumAVX512(total);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline size_t findNonzeroAVX512(const unsigned char * a, const size_t nbytes)
+{
+    size_t i = 0;
+    for (; i+256<=nbytes; i+=256) {
+        const __m512i acc = _mm512_or_si512(_mm512_or_si512(_mm512_loadu_si512(a+i), _mm512_loadu_si512(a+i+64)),
+                                            _mm512_or_si512(_mm512_loadu_si512(a+i+128), _mm512_loadu_si512(a+i+192)));
+        if (_mm512_test_epi64_mask(acc, acc)) { break; }
+    }
+    for (; i+64<=nbytes; i+=64) {
+        const __m512i va = _mm512_loadu_si512(a+i);
+        const uint64_t nonzero = _cvtmask64_u64(_mm512_test_epi8_mask(va, va));
+        if (nonzero) { return i + ctz64(nonzero); }
+    }
+    if (i < nbytes) {
+        const __mmask64 m = _cvtu64_mask64(~uint64_t(0) >> (64-(nbytes-i)));
+        const __m512i va = _mm512_maskz_loadu_epi8(m, a+i);
+        const uint64_t nonzero = _cvtmask64_u64(_mm512_test_epi8_mask(va, va));
+        if (nonzero) { return i + ctz64(nonzero); }
+    }
+    return nbytes;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+inline void expandBitsAVX512(const unsigned char * a, unsigned char * out, const size_t nbytes)
+{
+    const __m512i one = _mm512_set1_epi8(1);
+    size_t i = 0;
+    for (; i+8<=nbytes; i+=8) { // 64 bits are directly usable as byte mask
+        _mm512_storeu_si512(out+8*i, _mm512_maskz_mov_epi8(_cvtu64_mask64(load64(a+i)), one));
+    }
+    expandBitsScalar(a+i, out+8*i, nbytes-i);
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+inline void fillStreamAVX512(unsigned char * dst, const unsigned char value, const size_t nbytes) // non-temporal stores
+{
+    const size_t head = std::min(nbytes, (64 - reinterpret_cast<uintptr_t>(dst) % 64) % 64);
+    std::memset(dst, value, head);
+    const __m512i v = _mm512_set1_epi8(static_cast<char>(value));
+    size_t i = head;
+    for (; i+64<=nbytes; i+=64) { _mm512_stream_si512(reinterpret_cast<__m512i *>(dst+i), v); }
+    _mm_sfence();
+    std::memset(dst+i, value, nbytes-i);
+}
+
+#endif // BLOCK_KERNELS_X86
+
+
+// --- Runtime dispatch
+
+enum class Isa { scalar = 0, avx2 = 1, avx512 = 2 };
+
+struct KernelTable
+{
+    Isa isa;
+    void (*orInto)(unsigned char *, const unsigned char *, size_t);
+    void (*orManyInto)(unsigned char *, const unsigned char * const *, size_t, size_t);
+    void (*orManyTo)(unsigned char *, const unsigned char * const *, size_t, size_t);
+    bool (*equal)(const unsigned char *, const unsigned char *, size_t);
+    bool (*allOnes)(const unsigned char *, size_t);
+    uint64_t (*popcount)(const unsigned char *, size_t);
+    void (*expandBits)(const unsigned char *, unsigned char *, size_t);
+    uint64_t (*popcountAnd)(const unsigned char *, const unsigned char *, size_t);
+    uint64_t (*popcountOr)(const unsigned char *, const unsigned char *, size_t);
+    uint64_t (*popcountAndNot)(const unsigned char *, const unsigned char *, size_t);
+    bool (*anyAnd)(const unsigned char *, const unsigned char *, size_t);
+    bool (*anyAndNot)(const unsigned char *, const unsigned char *, size_t);
+    size_t (*findNonzero)(const unsigned char *, size_t);
+    uint64_t (*orIntoCount)(unsigned char *, const unsigned char *, size_t);
+    void (*fillStream)(unsigned char *, unsigned char, size_t);
+};
+
+inline Isa detectIsa() // best instruction set supported by the running CPU
+{
+#ifdef BLOCK_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) { return Isa::avx512; }
+    if (__builtin_cpu_supports("avx2")) { return Isa::avx2; }
+#endif
+    return Isa::scalar;
+}
+
+inline KernelTable makeKernelTable(Isa isa)
+{
+    if (static_cast<int>(isa) > static_cast<int>(detectIsa())) { isa = detectIsa(); } // never select unsupported code
+#ifdef BLOCK_KERNELS_X86
+    if (isa == Isa::avx512) {
+        return KernelTable{ isa, &orIntoAVX512, &orManyAVX512<true>, &orManyAVX512<false>, &equalAVX512, &allOnesAVX512,
+                            __builtin_cpu_supports("avx512vpopcntdq") ? &popcountAVX512VPOPCNT : &popcountAVX512, &expandBitsAVX512,
+                            &popcountOpAVX512<BinOp::and_>, &popcountOpAVX512<BinOp::or_>, &popcountOpAVX512<BinOp::andnot>,
+                            &anyOpAVX512<BinOp::and_>, &anyOpAVX512<BinOp::andnot>, &findNonzeroAVX512, &orIntoCountAVX512, &fillStreamAVX512 };
+    }
+    if (isa == Isa::avx2) {
+        return KernelTable{ isa, &orIntoAVX2, &orManyAVX2<true>, &orManyAVX2<false>, &equalAVX2, &allOnesAVX2, &popcountAVX2, &expandBitsAVX2,
+                            &popcountOpAVX2<BinOp::and_>, &popcountOpAVX2<BinOp::or_>, &popcountOpAVX2<BinOp::andnot>,
+                            &anyOpAVX2<BinOp::and_>, &anyOpAVX2<BinOp::andnot>, &findNonzeroAVX2, &orIntoCountAVX2, &fillStreamAVX2 };
+    }
+#endif
+    return KernelTable{ Isa::scalar, &orIntoScalar, &orManyScalar<true>, &orManyScalar<false>, &equalScalar, &allOnesScalar, &popcountScalar, &expandBitsScalar,
+                        &popcountOpScalar<BinOp::and_>, &popcountOpScalar<BinOp::or_>, &popcountOpScalar<BinOp::andnot>,
+                        &anyOpScalar<BinOp::and_>, &anyOpScalar<BinOp::andnot>, &findNonzeroScalar, &orIntoCountScalar, &fillStreamScalar };
+}
+
+inline KernelTable & kernels() // resolved once, on first use
+{
+    static KernelTable table = makeKernelTable(detectIsa());
+    return table;
+}
+
+inline Isa forceIsa(const Isa isa) // for testing/benchmarking: use given (or next best supported) kernels
+{
+    kernels() = makeKernelTable(isa);
+    return kernels().isa;
+}
+
+
+// --- Entry points (short ranges are not worth the indirect call)
+
+static constexpr size_t min_dispatch_bytes = 64;
+
+inline void orInto(unsigned char * dst, const unsigned char * src, const size_t nbytes)
+{
+    if (nbytes < min_dispatch_bytes) { orIntoScalar(dst, src, nbytes); }
+    else { kernels().orInto(dst, src, nbytes); }
+}
+
+inline uint64_t orIntoCount(unsigned char * dst, const unsigned char * src, const size_t nbytes) // dst |= src, returns popcount(dst)
+{
+    if (nbytes < min_dispatch_bytes) { return orIntoCountScalar(dst, src, nbytes); }
+    return kernels().orIntoCount(dst, src, nbytes);
+}
+
+inline void orManyInto(unsigned char * dst, const unsigned char * const * srcs, const size_t nsrcs, const size_t nbytes) // dst |= OR of srcs
+{
+    if (nbytes < min_dispatch_bytes) { orManyScalar<true>(dst, srcs, nsrcs, nbytes); }
+    else { kernels().orManyInto(dst, srcs, nsrcs, nbytes); }
+}
+
+inline void orManyTo(unsigned char * dst, const unsigned char * const * srcs, const size_t nsrcs, const size_t nbytes) // dst = OR of srcs
+{
+    if (nbytes < min_dispatch_bytes) { orManyScalar<false>(dst, srcs, nsrcs, nbytes); }
+    else { kernels().orManyTo(dst, srcs, nsrcs, nbytes); }
+}
+
+inline bool equal(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    if (nbytes < min_dispatch_bytes) { return equalScalar(a, b, nbytes); }
+    return kernels().equal(a, b, nbytes);
+}
+
+inline bool allOnes(const unsigned char * a, const size_t nbytes)
+{
+    if (nbytes < min_dispatch_bytes) { return allOnesScalar(a, nbytes); }
+    return kernels().allOnes(a, nbytes);
+}
+
+inline uint64_t popcount(const unsigned char * a, const size_t nbytes)
+{
+    if (nbytes < min_dispatch_bytes) { return popcountScalar(a, nbytes); }
+    return kernels().popcount(a, nbytes);
+}
+
+inline void expandBits(const unsigned char * a, unsigned char * out, const size_t nbytes) // out[8*nbytes] = 0/1 per bit
+{
+    if (nbytes < min_dispatch_bytes/8) { expandBitsScalar(a, out, nbytes); }
+    else { kernels().expandBits(a, out, nbytes); }
+}
+
+inline uint64_t popcountAnd(const unsigned char * a, const unsigned char * b, const size_t nbytes) // popcount(a & b)
+{
+    if (nbytes < min_dispatch_bytes) { return popcountOpScalar<BinOp::and_>(a, b, nbytes); }
+    return kernels().popcountAnd(a, b, nbytes);
+}
+
+inline uint64_t popcountOr(const unsigned char * a, const unsigned char * b, const size_t nbytes) // popcount(a | b)
+{
+    if (nbytes < min_dispatch_bytes) { return popcountOpScalar<BinOp::or_>(a, b, nbytes); }
+    return kernels().popcountOr(a, b, nbytes);
+}
+
+inline uint64_t popcountAndNot(const unsigned char * a, const unsigned char * b, const size_t nbytes) // popcount(a & ~b)
+{
+    if (nbytes < min_dispatch_bytes) { return popcountOpScalar<BinOp::andnot>(a, b, nbytes); }
+    return kernels().popcountAndNot(a, b, nbytes);
+}
+
+inline bool anyAnd(const unsigned char * a, const unsigned char * b, const size_t nbytes) // (a & b) != 0
+{
+    if (nbytes < min_dispatch_bytes) { return anyOpScalar<BinOp::and_>(a, b, nbytes); }
+    return kernels().anyAnd(a, b, nbytes);
+}
+
+inline bool anyAndNot(const unsigned char * a, const unsigned char * b, const size_t nbytes) // (a & ~b) != 0
+{
+    if (nbytes < min_dispatch_bytes) { return anyOpScalar<BinOp::andnot>(a, b, nbytes); }
+    return kernels().anyAndNot(a, b, nbytes);
+}
+
+inline size_t findNonzero(const unsigned char * a, const size_t nbytes) // offset of first non-zero byte, or nbytes
+{
+    if (nbytes < min_dispatch_bytes) { return findNonzeroScalar(a, nbytes); }
+    return kernels().findNonzero(a, nbytes);
+}
+
+
+// --- Streaming entry points, for ranges that don't fit into the caches
+
+static constexpr size_t stream_chunk_bytes = 4096; // the kernels run on chunks of this size
+
+inline size_t & streamPrefetchDistance() // bytes prefetched ahead of the chunk being processed (0 = no prefetch)
+{   // tuned with bench_streaming (should cover the memory latency at full bandwidth), may be changed at runtime
+    static size_t distance = 4096;
+    return distance;
+}
+
+inline void prefetchAhead(const unsigned char * a, const size_t offset, const size_t nbytes) // prefetch the chunk at offset+distance
+{
+#if defined(__GNUC__)
+    const size_t distance = streamPrefetchDistance();
+    if (distance == 0) { return; }
+    const size_t first = offset + distance, last = std::min(nbytes, first + stream_chunk_bytes);
+    for (size_t i=first; i<last; i+=64) { __builtin_prefetch(a+i, 0, 1); } // into L2, the non-temporal hint halved the bandwidth in bench_streaming
+#else
+    (void)a; (void)offset; (void)nbytes;
+#endif
+}
+
+inline uint64_t popcountStream(const unsigned char * a, const size_t nbytes)
+{
+    uint64_t count = 0;
+    for (size_t i=0; i<nbytes; i+=stream_chunk_bytes) {
+        prefetchAhead(a, i, nbytes);
+        count += popcount(a+i, std::min(stream_chunk_bytes, nbytes-i));
+    }
+    return count;
+}
+
+inline bool equalStream(const unsigned char * a, const unsigned char * b, const size_t nbytes)
+{
+    for (size_t i=0; i<nbytes; i+=stream_chunk_bytes) {
+        prefetchAhead(a, i, nbytes);
+        prefetchAhead(b, i, nbytes);
+        if (!equal(a+i, b+i, std::min(stream_chunk_bytes, nbytes-i))) { return false; }
+    }
+    return true;
+}
+
+inline bool allOnesStream(const unsigned char * a, const size_t nbytes)
+{
+    for (size_t i=0; i<nbytes; i+=stream_chunk_bytes) {
+        prefetchAhead(a, i, nbytes);
+        if (!allOnes(a+i, std::min(stream_chunk_bytes, nbytes-i))) { return false; }
+    }
+    return true;
+}
+
+inline void expandBitsStream(const unsigned char * a, unsigned char * out, const size_t nbytes) // see expandBits, prefetches only a
+{
+    for (size_t i=0; i<nbytes; i+=stream_chunk_bytes) {
+        prefetchAhead(a, i, nbytes);
+        expandBits(a+i, out+8*i, std::min(stream_chunk_bytes, nbytes-i));
+    }
+}
+
+inline void fillStream(unsigned char * dst, const unsigned char value, const size_t nbytes) // memset with non-temporal stores
+{
+    if (nbytes < min_dispatch_bytes) { fillStreamScalar(dst, value, nbytes); }
+    else { kernels().fillStream(dst, value, nbytes); }
+}
+
+} // namespace blockkernels
+
+
+#endif
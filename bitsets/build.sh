@@ -1,5 +1,18 @@
 #!/bin/sh
 
 . ./config.sh
-#${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -o exe main.cpp
-${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -o test test.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o exe main.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o test test.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_epoch bench_epoch.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_atomic bench_atomic.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_parallel bench_parallel.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_compressed bench_compressed.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_mergeall bench_mergeall.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_expr bench_expr.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_storage bench_storage.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_serialize bench_serialize.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_rankselect bench_rankselect.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_counting bench_counting.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_snapshot bench_snapshot.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_multimask bench_multimask.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_streaming bench_streaming.cpp
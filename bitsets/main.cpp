@@ -0,0 +1,267 @@
+#include "OnewayBitset.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+// Benchmark of the basic OnewayBitset operations against the standard alternatives
+//
+// The benchmarks in ../change_tracking_nextlvl measure the bitsets inside a sampler, where
+// most of the time goes to random numbers and the observable. Here we isolate the operations:
+// random set() and get(), a get() scan over all bits, merge (a |= b), count(), reset(),
+// setAll() and getAll() (export to a bool array).
+//
+// We compare the following approaches:
+// Approach 1-4 (int8/16/32/64): OnewayBitset with blocks of 1, 2, 4 and 8 bytes
+// Approach 5 (vector<bool>): std::vector<bool>, merge and count via the element-wise standard
+//            algorithms (there is no |=), reset/setAll via std::fill
+// Approach 6 (std::bitset): std::bitset<N> on the heap, with its own |=, count(), reset() and set()
+// Approach 7 (bool[]): raw bool array, with loops that the compiler can vectorize
+//
+// The following settings are configured:
+// 5 runs per benchmark, sizes from 2^15 bits (4 kB, L1) over 2^18 (L2), 2^22 (L3) and
+// 2^28 (32 MB) to 2^34 bits (2 GB, bitsets only). Set bit densities of 10^-3, 0.1 and 0.5,
+// which matter for the get() scan, count, merge and getAll (the bitsets are filled by random
+// sets, so high densities are skipped for the largest sizes). Every measurement processes at
+// least 2^28 bits or 10^7 random accesses (small bitsets are processed repeatedly).
+// The bool[] approach and getAll are skipped above 2^30 bits (they need a byte per bit).
+//
+// Expectation: The word-wise operations (merge, count, reset, setAll) should be memory bound
+// for all approaches except vector<bool>, whose element-wise algorithms should be an order of
+// magnitude slower. The bitsets move 8x less data than bool[], so they should win once the
+// data does not fit into the cache anymore. Random set/get should cost about the same for all
+// bitsets (shift and mask) and become faster than bool[] for large sizes (less cache misses).
+// The block size of OnewayBitset should not matter for the bulk operations (which use the
+// vectorized block kernels for every AllocT), but may matter for the get() scan.
+// Result (AVX-512 machine, 1 core, 5 GB RAM, sizes 2^15 to 2^28 bits; 2^34 was not run there, it
+// needs two 2 GB containers per approach, i.e. over 4 GB, and the vector<bool> merge alone takes
+// 40 s per run at 2.3 ns per bit, i.e. minutes for the 5 runs): merge/count/reset/setAll of OnewayBitset and std::bitset
+// take 0.6-4 ps per bit up to 2^22 bits and 4-10 ps at 2^28 bits. bool[] takes 7-30x longer for
+// merge/reset/setAll and 60-350x for count (std::count on bool is not vectorized). The element-
+// wise vector<bool> algorithms take 0.65 (count) and 2.3 ns (merge) per bit at every size, that
+// is 100-1400x longer. Random set/get take 1.2-1.8 ns up to 2^22 bits for all approaches, at 2^28
+// bits 3.5-5 ns for the bitsets vs 9-11 ns for bool[]. The get() scan costs 0.75-1.05 ns per bit
+// for all bitsets, independent of density (the compiler makes the loop branchless), vs 1.3-1.5 ns
+// for vector<bool> and 0.32-0.42 ns for bool[]. getAll() of OnewayBitset takes 8-130 ps per bit
+// (growing with the size of the bool output), i.e. 5-120x less than the loops needed for
+// vector<bool> and std::bitset. Overall, the block size of OnewayBitset did not make a measurable
+// difference, except for a 20% slower get() scan with int32 blocks.
+
+using BenchSizeT = uint64_t;
+
+constexpr BenchSizeT min_bulk_bits = BenchSizeT(1) << 28; // process at least that many bits per measurement
+constexpr BenchSizeT max_bool_bits = BenchSizeT(1) << 30; // bool[] and getAll only up to that size
+constexpr BenchSizeT max_fill_sets = BenchSizeT(1) << 27; // skip densities that need more random sets to fill
+constexpr BenchSizeT naccess = 10000000; // random set() / get() per measurement
+
+BenchSizeT sink = 0; // accumulates results, so that nothing is optimized out
+
+
+// --- Uniform wrappers around the compared containers ---
+
+template <typename AllocT>
+struct OnewayAdaptor
+{
+    OnewayBitset<BenchSizeT, AllocT> bits;
+
+    explicit OnewayAdaptor(const BenchSizeT nbits): bits(nbits) {}
+    void set(const BenchSizeT i) { bits.set(i); }
+    bool get(const BenchSizeT i) const { return bits.get(i); }
+    void merge(const OnewayAdaptor &other) { bits.merge(other.bits); }
+    BenchSizeT count() const { return bits.count(); }
+    void reset() { bits.reset(); }
+    void setAll() { bits.setAll(); }
+    void getAll(bool out[]) const { bits.getAll(out); }
+};
+
+struct VectorBoolAdaptor
+{
+    std::vector<bool> bits;
+
+    explicit VectorBoolAdaptor(const BenchSizeT nbits): bits(nbits, false) {}
+    void set(const BenchSizeT i) { bits[i] = true; }
+    bool get(const BenchSizeT i) const { return bits[i]; }
+    void merge(const VectorBoolAdaptor &other) { std::transform(bits.begin(), bits.end(), other.bits.begin(), bits.begin(), std::logical_or<bool>()); }
+    BenchSizeT count() const { return static_cast<BenchSizeT>(std::count(bits.begin(), bits.end(), true)); }
+    void reset() { std::fill(bits.begin(), bits.end(), false); }
+    void setAll() { std::fill(bits.begin(), bits.end(), true); }
+    void getAll(bool out[]) const { std::copy(bits.begin(), bits.end(), out); }
+};
+
+template <size_t N>
+struct StdBitsetAdaptor
+{
+    std::unique_ptr<std::bitset<N>> bits; // too large for the stack
+
+    explicit StdBitsetAdaptor(const BenchSizeT): bits(new std::bitset<N>()) {}
+    void set(const BenchSizeT i) { (*bits)[i] = true; }
+    bool get(const BenchSizeT i) const { return (*bits)[i]; }
+    void merge(const StdBitsetAdaptor &other) { *bits |= *other.bits; }
+    BenchSizeT count() const { return static_cast<BenchSizeT>(bits->count()); }
+    void reset() { bits->reset(); }
+    void setAll() { bits->set(); }
+    void getAll(bool out[]) const { for (size_t i=0; i<N; ++i) { out[i] = (*bits)[i]; } }
+};
+
+struct BoolArrayAdaptor
+{
+    BenchSizeT nbits;
+    std::unique_ptr<bool[]> bits;
+
+    explicit BoolArrayAdaptor(const BenchSizeT n_bits): nbits(n_bits), bits(new bool[n_bits]()) {}
+    void set(const BenchSizeT i) { bits[i] = true; }
+    bool get(const BenchSizeT i) const { return bits[i]; }
+    void merge(const BoolArrayAdaptor &other) { for (BenchSizeT i=0; i<nbits; ++i) { bits[i] = bits[i] | other.bits[i]; } }
+    BenchSizeT count() const { return static_cast<BenchSizeT>(std::count(bits.get(), bits.get()+nbits, true)); }
+    void reset() { std::fill(bits.get(), bits.get()+nbits, false); }
+    void setAll() { std::fill(bits.get(), bits.get()+nbits, true); }
+    void getAll(bool out[]) const { std::copy(bits.get(), bits.get()+nbits, out); }
+};
+
+
+// --- Benchmark execution ---
+
+void print_result(const std::string &label, const std::pair<double, double> &result, const bool perbit)
+{
+    const double time_scale = perbit ? 1e12 : 1e9; // picoseconds per bit, nanoseconds per access
+    std::cout << label << ":" << std::setw(std::max(1, 40-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first*time_scale << " +- " << result.second*time_scale << (perbit ? " picoseconds" : " nanoseconds") << std::endl;
+}
+
+uint64_t next_rand(uint64_t &state) { state = state*6364136223846793005ULL + 1442695040888963407ULL; return state >> 16; }
+
+template <class AdaptorT>
+void fill_random(AdaptorT &bitset, const BenchSizeT nbits, const BenchSizeT nsets, uint64_t seed)
+{   // nbits is a power of 2
+    bitset.reset();
+    for (BenchSizeT k=0; k<nsets; ++k) { bitset.set(next_rand(seed) & (nbits-1)); }
+}
+
+template <class AdaptorT>
+void run_container(const std::string &name, const BenchSizeT nbits, const int nruns)
+{
+    const std::vector<double> densities {0.001, 0.1, 0.5};
+    const BenchSizeT nrep = std::max(BenchSizeT(1), min_bulk_bits/nbits); // repetitions of the bulk operations
+    const double bulk_scale = 1./(static_cast<double>(nrep)*nbits); // time per bit
+    Timer timer(1.);
+    AdaptorT bitset1(nbits), bitset2(nbits);
+    std::unique_ptr<bool[]> out(nbits <= max_bool_bits ? new bool[nbits] : nullptr);
+
+    print_result("t/access ( random set, " + name + " )", sample_benchmark([&] {
+        uint64_t state = 1337;
+        timer.reset();
+        for (BenchSizeT k=0; k<naccess; ++k) { bitset1.set(next_rand(state) & (nbits-1)); }
+        return timer.elapsed()/naccess;
+    }, nruns), false);
+
+    print_result("t/access ( random get, " + name + " )", sample_benchmark([&] {
+        uint64_t state = 4242;
+        timer.reset();
+        for (BenchSizeT k=0; k<naccess; ++k) { sink += bitset1.get(next_rand(state) & (nbits-1)); }
+        return timer.elapsed()/naccess;
+    }, nruns), false);
+
+    for (const double density : densities) {
+        const BenchSizeT nsets = static_cast<BenchSizeT>(density*nbits);
+        const std::string dlabel = name + ", d=" + std::to_string(density).substr(0, 5);
+        if (nsets > max_fill_sets) {
+            std::cout << "(density " << density << " skipped, too expensive to fill)" << std::endl;
+            continue;
+        }
+        fill_random(bitset1, nbits, nsets, 1337);
+        fill_random(bitset2, nbits, nsets, 4242);
+
+        print_result("t/bit ( get scan, " + dlabel + " )", sample_benchmark([&] {
+            BenchSizeT count = 0;
+            timer.reset();
+            for (BenchSizeT r=0; r<nrep; ++r) {
+                for (BenchSizeT i=0; i<nbits; ++i) { if (bitset1.get(i)) { ++count; } }
+            }
+            const double time = timer.elapsed();
+            sink += count;
+            return time*bulk_scale;
+        }, nruns), true);
+
+        print_result("t/bit ( count, " + dlabel + " )", sample_benchmark([&] {
+            timer.reset();
+            for (BenchSizeT r=0; r<nrep; ++r) { sink += bitset1.count(); }
+            return timer.elapsed()*bulk_scale;
+        }, nruns), true);
+
+        print_result("t/bit ( merge, " + dlabel + " )", sample_benchmark([&] {
+            timer.reset();
+            for (BenchSizeT r=0; r<nrep; ++r) { bitset1.merge(bitset2); } // same work every time, the result is the same
+            return timer.elapsed()*bulk_scale;
+        }, nruns), true);
+
+        if (out) {
+            print_result("t/bit ( getAll, " + dlabel + " )", sample_benchmark([&] {
+                timer.reset();
+                for (BenchSizeT r=0; r<nrep; ++r) { bitset1.getAll(out.get()); }
+                const double time = timer.elapsed();
+                sink += out[nbits/2];
+                return time*bulk_scale;
+            }, nruns), true);
+        }
+    }
+
+    print_result("t/bit ( reset, " + name + " )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT r=0; r<nrep; ++r) { bitset1.set(r % nbits); bitset1.reset(); } // set() so that OnewayBitset has to work
+        return timer.elapsed()*bulk_scale;
+    }, nruns), true);
+
+    print_result("t/bit ( setAll, " + name + " )", sample_benchmark([&] {
+        timer.reset();
+        for (BenchSizeT r=0; r<nrep; ++r) { bitset1.setAll(); }
+        const double time = timer.elapsed();
+        sink += bitset1.get(nbits-1);
+        return time*bulk_scale;
+    }, nruns), true);
+}
+
+template <unsigned LogN>
+void run_size(const int nruns)
+{
+    constexpr BenchSizeT nbits = BenchSizeT(1) << LogN;
+    std::cout << std::endl << "Size: 2^" << LogN << " bits (" << (nbits/8 >= 1024*1024 ? nbits/8/1024/1024 : nbits/8/1024) << (nbits/8 >= 1024*1024 ? " MB" : " kB") << ")" << std::endl << std::endl;
+
+    run_container< OnewayAdaptor<uint8_t> >("int8", nbits, nruns);
+    run_container< OnewayAdaptor<uint16_t> >("int16", nbits, nruns);
+    run_container< OnewayAdaptor<uint32_t> >("int32", nbits, nruns);
+    run_container< OnewayAdaptor<uint64_t> >("int64", nbits, nruns);
+    run_container< VectorBoolAdaptor >("vector<bool>", nbits, nruns);
+    run_container< StdBitsetAdaptor<static_cast<size_t>(nbits)> >("std::bitset", nbits, nruns);
+    if (nbits <= max_bool_bits) { run_container< BoolArrayAdaptor >("bool[]", nbits, nruns); }
+    else { std::cout << "(bool[] skipped, too large)" << std::endl; }
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 5;
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (time per random access / per bit of bulk operations):" << std::endl;
+
+    run_size<15>(nruns);
+    run_size<18>(nruns);
+    run_size<22>(nruns);
+    run_size<28>(nruns);
+    run_size<34>(nruns);
+
+    std::cout << std::endl << "(checksum " << sink << ")" << std::endl;
+    std::cout << "=========================================================================================" << std::endl << std::endl << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,451 @@
+/* Storage policies for OnewayBitset
+   Author: Jan Kessler (2019)
+
+   A storage policy provides the memory for the blocks of a bitset. The bitset keeps one
+   instance of the policy and calls (in this order, once per allocation):
+
+     template <typename T> T * allocate(size_t n);  // memory for n blocks of type T
+     StorageState restoredState() const;            // state of the memory returned by allocate()
+     void sync(const void * p, size_t nbytes);      // flush blocks to backing store (if any)
+     void storeState(bool nonzero);                 // persist the any-flag (if possible), right before:
+     template <typename T> void deallocate(T * p, size_t n);
+
+   and for copies of a bitset it asks selectOnCopy() for the storage of the new bitset.
+   Policies whose allocate() releases or reuses the memory of the previous allocation
+   (one mapping per instance) specialize storage_reuses_memory, see below.
+
+   Available policies: HeapStorage (default), AlignedStorage<Align> (cache line aligned heap
+   memory), HugePageStorage (anonymous huge page mappings), MappedFileStorage (files) and
+   ViewStorage (zero-copy views of serialized bitsets, see onewayformat below).
+*/
+
+#ifndef ONEWAY_STORAGE_HPP
+#define ONEWAY_STORAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <new>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ONEWAY_STORAGE_MMAP 1
+#endif
+
+enum class StorageState
+{
+    fresh, // uninitialized memory, bitset has to zero it
+    zero, // memory is known to be all zero
+    nonzero, // restored content, known to contain set bits
+    unknown // restored content, but any-flag unknown (e.g. after a crash), bitset has to scan it
+};
+
+
+namespace onewayformat
+// Binary format of OnewayBitset::write()/read(): a header of 64 byte, followed by the raw
+// blocks in the byte order of the writer, i.e. a memory image of the bitset. The header
+// keeps the blocks 64 byte aligned if the buffer is, so that they can be used in place.
+{
+    constexpr uint16_t version = 1;
+    constexpr uint8_t little_endian = 1, big_endian = 2;
+
+    constexpr uint8_t native_endian =
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        big_endian;
+#else
+        little_endian;
+#endif
+
+    struct Header
+    {
+        char magic[4]; // "OWBS"
+        uint16_t version;
+        uint8_t blockbytes; // sizeof(AllocT) of the writer
+        uint8_t endian; // byte order of the writer (of all following fields and the blocks)
+        uint64_t nbits;
+        uint64_t nbytes; // size of the block data following the header
+        uint8_t nonzero; // any-flag
+        uint8_t reserved[39];
+    };
+    static_assert(sizeof(Header) == 64, "Header must have 64 byte.");
+
+    template <typename T>
+    T byteswap(T x) // reverse byte order of unsigned integer (compiles to bswap)
+    {
+        T r = 0;
+        for (size_t i=0; i<sizeof(T); ++i) {
+            r = static_cast<T>((r << 8) | (x & 0xff));
+            x = static_cast<T>(x >> 8);
+        }
+        return r;
+    }
+
+    inline Header makeHeader(const uint64_t nbits, const uint8_t blockbytes, const uint64_t nbytes, const bool nonzero)
+    {
+        Header header{};
+        std::memcpy(header.magic, "OWBS", sizeof(header.magic));
+        header.version = version;
+        header.blockbytes = blockbytes;
+        header.endian = native_endian;
+        header.nbits = nbits;
+        header.nbytes = nbytes;
+        header.nonzero = nonzero ? 1 : 0;
+        return header;
+    }
+
+    inline Header checkHeader(Header header) // validate and convert to native byte order, throws on error
+    {
+        if (std::memcmp(header.magic, "OWBS", sizeof(header.magic)) != 0) { throw std::runtime_error("onewayformat: not a serialized bitset"); }
+        if (header.endian != native_endian) {
+            if (header.endian != little_endian && header.endian != big_endian) { throw std::runtime_error("onewayformat: invalid byte order"); }
+            header.version = byteswap(header.version);
+            header.nbits = byteswap(header.nbits);
+            header.nbytes = byteswap(header.nbytes);
+        }
+        if (header.version != version) { throw std::runtime_error("onewayformat: unsupported version"); }
+        const uint64_t blockbits = uint64_t(header.blockbytes)*8;
+        if (header.blockbytes == 0 || (header.blockbytes & (header.blockbytes-1)) != 0 || header.blockbytes > 8
+            || header.nbytes != (header.nbits + blockbits - 1)/blockbits*header.blockbytes) {
+            throw std::runtime_error("onewayformat: inconsistent header");
+        }
+        return header;
+    }
+}
+
+
+template <class StorageT>
+struct storage_reuses_memory: std::false_type {}; // true if a new allocation replaces the previous one, i.e. the old blocks are gone once allocate() returns
+
+
+struct HeapStorage
+// Default policy: plain new[]/delete[] (as OnewayBitset always did)
+{
+    template <typename T> T * allocate(const size_t n) { return new T[n]; }
+    template <typename T> void deallocate(T * p, size_t /*n*/) { delete [] p; }
+
+    StorageState restoredState() const { return StorageState::fresh; }
+    void sync(const void * /*p*/, size_t /*nbytes*/) {}
+    void storeState(bool /*nonzero*/) {}
+
+    HeapStorage selectOnCopy() const { return HeapStorage(); }
+};
+
+
+template <size_t Align = 64>
+struct AlignedStorage
+// Like HeapStorage, but the blocks start at a multiple of Align bytes (default: one cache
+// line, i.e. one AVX-512 vector), so that the block kernels never split a load or store
+// across cache lines. new[] only guarantees alignof(std::max_align_t), i.e. 16 byte.
+// We over-allocate and keep the original pointer right in front of the aligned blocks.
+{
+    static_assert(Align >= sizeof(void *) && (Align & (Align-1)) == 0, "Align must be a power of 2, at least pointer size.");
+
+    template <typename T> T * allocate(const size_t n)
+    {
+        char * const raw = new char[n*sizeof(T) + Align + sizeof(void *)];
+        const uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void *) + Align - 1) & ~static_cast<uintptr_t>(Align - 1);
+        std::memcpy(reinterpret_cast<char *>(aligned) - sizeof(void *), &raw, sizeof(void *));
+        return reinterpret_cast<T *>(aligned);
+    }
+
+    template <typename T> void deallocate(T * p, size_t /*n*/)
+    {
+        char * raw;
+        std::memcpy(&raw, reinterpret_cast<char *>(p) - sizeof(void *), sizeof(void *));
+        delete [] raw;
+    }
+
+    StorageState restoredState() const { return StorageState::fresh; }
+    void sync(const void * /*p*/, size_t /*nbytes*/) {}
+    void storeState(bool /*nonzero*/) {}
+
+    AlignedStorage selectOnCopy() const { return AlignedStorage(); }
+};
+
+
+struct ViewStorage
+// Zero-copy view of a serialized bitset (see onewayformat), e.g. of a checkpoint file that
+// was mapped into memory:
+//   ViewStorage view(mapped, filesize); // validates the header (throws)
+//   OnewayBitset<size_t, uint64_t, onewayopt::none, ViewStorage> mask(view.getNBits(), view);
+// The bitset then uses the blocks of the buffer in place, so the buffer has to outlive it,
+// has to be aligned to sizeof(AllocT) and written with the same AllocT and byte order (or
+// the constructor throws). Modifying the bitset writes to the buffer (unless it is read-only,
+// then don't), but the header is not updated. Copies, and the bitset after assignments that
+// need more blocks, allocate with new[] instead, like HeapStorage.
+{
+    ViewStorage(): _header{}, _data(nullptr), _view(nullptr), _state(StorageState::fresh) {} // owning, for copies
+
+    ViewStorage(const void * buffer, const size_t nbytes): _data(nullptr), _view(nullptr), _state(StorageState::fresh)
+    {
+        if (nbytes < sizeof(_header)) { throw std::runtime_error("ViewStorage: buffer too small"); }
+        std::memcpy(&_header, buffer, sizeof(_header));
+        _header = onewayformat::checkHeader(_header);
+        if (_header.endian != onewayformat::native_endian) { throw std::runtime_error("ViewStorage: buffer has foreign byte order"); }
+        if (nbytes - sizeof(_header) < _header.nbytes) { throw std::runtime_error("ViewStorage: buffer truncated"); }
+        _data = static_cast<const char *>(buffer) + sizeof(_header);
+        if (reinterpret_cast<uintptr_t>(_data) % _header.blockbytes != 0) { throw std::runtime_error("ViewStorage: buffer misaligned"); }
+    }
+
+    uint64_t getNBits() const { return _header.nbits; }
+
+    template <typename T>
+    T * allocate(const size_t n)
+    {
+        if (_data) { // hand out the view (once)
+            if (sizeof(T) != _header.blockbytes || n*sizeof(T) != _header.nbytes) { throw std::runtime_error("ViewStorage: bitset does not match buffer"); }
+            T * const p = static_cast<T *>(const_cast<void *>(_data));
+            _data = nullptr;
+            _view = p;
+            _state = _header.nonzero ? StorageState::nonzero : StorageState::zero;
+            return p;
+        }
+        _state = StorageState::fresh;
+        return new T[n];
+    }
+
+    template <typename T>
+    void deallocate(T * p, size_t /*n*/)
+    {
+        if (static_cast<void *>(p) != _view) { delete [] p; }
+    }
+
+    StorageState restoredState() const { return _state; }
+    void sync(const void * /*p*/, size_t /*nbytes*/) {}
+    void storeState(bool /*nonzero*/) {}
+
+    ViewStorage selectOnCopy() const { return ViewStorage(); }
+
+private:
+    onewayformat::Header _header;
+    const void * _data; // blocks of the buffer, until handed out
+    void * _view; // blocks of the buffer, after handed out
+    StorageState _state;
+};
+
+
+#ifdef ONEWAY_STORAGE_MMAP
+
+struct MappedFileStorage
+// Blocks live in a memory-mapped file, so that a bitset can outlive the process, be shared
+// read-only between processes and pages are only read from disk when they are accessed.
+//
+// File layout: one page of header (magic, size of block data, any-flag state), followed by
+// the raw blocks (page aligned). If the file exists with the same block data size, its content
+// is restored; otherwise it is (re)created and zero-filled by the kernel, i.e. lazily. While a
+// writable bitset is open, the header marks the state as unknown, so that after a crash the
+// next process rescans the blocks. Only on destruction the exact any-flag is stored.
+//
+// With an empty path, anonymous memory is mapped instead (used for copies of a bitset).
+// Bitsets on read-only storage must not be modified (this is not checked, writes will crash).
+{
+    enum Flags : unsigned
+    {
+        readonly = 1u << 0, // map read-only (e.g. to share a mask between processes)
+        populate = 1u << 1, // prefault all pages on open (MAP_POPULATE, Linux only)
+    };
+
+    explicit MappedFileStorage(const std::string &path = "", const unsigned flags = 0u, const int advice = MADV_NORMAL):
+        _path(path), _flags(flags), _advice(advice), _base(nullptr), _mapsize(0), _state(StorageState::fresh)
+    {}
+
+    MappedFileStorage(const MappedFileStorage &other): // copies don't share the mapping
+        _path(other._path), _flags(other._flags), _advice(other._advice), _base(nullptr), _mapsize(0), _state(StorageState::fresh)
+    {}
+
+    MappedFileStorage(MappedFileStorage &&other) noexcept:
+        _path(std::move(other._path)), _flags(other._flags), _advice(other._advice),
+        _base(std::exchange(other._base, nullptr)), _mapsize(std::exchange(other._mapsize, 0)), _state(other._state)
+    {}
+
+    MappedFileStorage& operator=(MappedFileStorage other) noexcept
+    {
+        std::swap(_path, other._path);
+        std::swap(_flags, other._flags);
+        std::swap(_advice, other._advice);
+        std::swap(_base, other._base);
+        std::swap(_mapsize, other._mapsize);
+        std::swap(_state, other._state);
+        return *this;
+    }
+
+    ~MappedFileStorage() { _unmap(); } // bitsets deallocate, this is just a safety net
+
+    template <typename T>
+    T * allocate(const size_t n)
+    {
+        _unmap();
+        const size_t nbytes = n*sizeof(T);
+        _mapsize = header_size + nbytes;
+        const bool ro = (_flags & readonly) != 0;
+
+        int mapflags = 0;
+#ifdef MAP_POPULATE
+        if (_flags & populate) { mapflags |= MAP_POPULATE; }
+#endif
+        if (_path.empty()) { // anonymous memory, zero-filled by the kernel
+            _base = _mmap(nullptr, _mapsize, PROT_READ | PROT_WRITE, mapflags | MAP_PRIVATE | MAP_ANONYMOUS, -1);
+            _state = StorageState::zero;
+        }
+        else {
+            const int fd = ::open(_path.c_str(), ro ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+            if (fd < 0) { throw std::runtime_error("MappedFileStorage: cannot open " + _path); }
+
+            Header header{};
+            struct stat st;
+            const bool exists = (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == _mapsize
+                                 && ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+                                 && std::memcmp(header.magic, _magic(), sizeof(header.magic)) == 0 && header.nbytes == nbytes);
+            if (!exists) {
+                if (ro) { ::close(fd); throw std::runtime_error("MappedFileStorage: no matching bitset in " + _path); }
+                if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, static_cast<off_t>(_mapsize)) != 0) {
+                    ::close(fd);
+                    throw std::runtime_error("MappedFileStorage: cannot resize " + _path);
+                }
+            }
+            _base = _mmap(nullptr, _mapsize, ro ? PROT_READ : (PROT_READ | PROT_WRITE), mapflags | MAP_SHARED, fd);
+            ::close(fd); // the mapping keeps the file open
+
+            _state = !exists ? StorageState::zero
+                     : (header.state <= static_cast<uint64_t>(StorageState::unknown) ? static_cast<StorageState>(header.state) : StorageState::unknown);
+            if (!ro) { _writeHeader(nbytes, StorageState::unknown); } // until we know better
+        }
+        if (_advice != MADV_NORMAL) { ::madvise(_base, _mapsize, _advice); } // just a hint
+        return reinterpret_cast<T *>(static_cast<char *>(_base) + header_size);
+    }
+
+    template <typename T>
+    void deallocate(T * /*p*/, size_t /*n*/) { _unmap(); }
+
+    StorageState restoredState() const { return _state; }
+
+    void sync(const void * /*p*/, size_t /*nbytes*/)
+    {
+        if (_base && !_path.empty() && !(_flags & readonly)) { ::msync(_base, _mapsize, MS_SYNC); }
+    }
+
+    void storeState(const bool nonzero)
+    {
+        if (_base && !_path.empty() && !(_flags & readonly)) {
+            _writeHeader(_mapsize - header_size, nonzero ? StorageState::nonzero : StorageState::zero);
+        }
+    }
+
+    MappedFileStorage selectOnCopy() const { return MappedFileStorage("", _flags & ~readonly, _advice); }
+
+    const std::string & getPath() const { return _path; }
+
+private:
+    static constexpr size_t header_size = 4096; // keeps the blocks page aligned
+    static const char * _magic() { return "OWBSMAP1"; }
+
+    struct Header
+    {
+        char magic[8];
+        uint64_t nbytes; // size of block data
+        uint64_t state; // StorageState
+    };
+
+    std::string _path;
+    unsigned _flags;
+    int _advice;
+    void * _base; // start of the mapping (header)
+    size_t _mapsize;
+    StorageState _state;
+
+    static void * _mmap(void * addr, const size_t len, const int prot, const int flags, const int fd)
+    {
+        void * p = ::mmap(addr, len, prot, flags, fd, 0);
+        if (p == MAP_FAILED) { throw std::runtime_error("MappedFileStorage: mmap failed"); }
+        return p;
+    }
+
+    void _writeHeader(const size_t nbytes, const StorageState state)
+    {
+        Header header;
+        std::memcpy(header.magic, _magic(), sizeof(header.magic));
+        header.nbytes = nbytes;
+        header.state = static_cast<uint64_t>(state);
+        std::memcpy(_base, &header, sizeof(header));
+    }
+
+    void _unmap()
+    {
+        if (_base) { ::munmap(_base, _mapsize); }
+        _base = nullptr;
+        _mapsize = 0;
+    }
+};
+
+
+
+struct HugePageStorage
+// Blocks in anonymous memory backed by huge pages (2 MB on x86-64), to reduce TLB misses
+// on random access to multi-GB bitsets (a 4 kB page TLB covers just a few MB).
+// By default we map a 2 MB aligned region and ask for transparent huge pages via
+// madvise(MADV_HUGEPAGE), which works with THP in "madvise" or "always" mode.
+// With the hugetlb flag we try MAP_HUGETLB first, which needs pages reserved in
+// /proc/sys/vm/nr_hugepages, and silently fall back to the former if that fails.
+// The memory is zero-filled by the kernel, so the bitset doesn't touch it on construction
+// (pages are faulted in on first access, 512 times less often than with 4 kB pages).
+{
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    enum Flags : unsigned
+    {
+        hugetlb = 1u << 0, // try explicitly reserved huge pages (MAP_HUGETLB) first
+    };
+
+    explicit HugePageStorage(const unsigned flags = 0u): _flags(flags) {}
+
+    template <typename T>
+    T * allocate(const size_t n)
+    {
+        const size_t len = _mapLength(n*sizeof(T));
+#ifdef MAP_HUGETLB
+        if (_flags & hugetlb) {
+            void * p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) { return static_cast<T *>(p); }
+        }
+#endif
+        // map one huge page more than needed and trim, to get a huge page aligned region
+        void * p = ::mmap(nullptr, len + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) { throw std::bad_alloc(); }
+        const uintptr_t raw = reinterpret_cast<uintptr_t>(p);
+        const uintptr_t aligned = (raw + huge_page_size - 1) & ~static_cast<uintptr_t>(huge_page_size - 1);
+        if (aligned > raw) { ::munmap(p, aligned - raw); }
+        ::munmap(reinterpret_cast<void *>(aligned + len), raw + huge_page_size - aligned);
+#ifdef MADV_HUGEPAGE
+        ::madvise(reinterpret_cast<void *>(aligned), len, MADV_HUGEPAGE); // just a hint
+#endif
+        return reinterpret_cast<T *>(aligned);
+    }
+
+    template <typename T>
+    void deallocate(T * p, const size_t n) { ::munmap(p, _mapLength(n*sizeof(T))); }
+
+    StorageState restoredState() const { return StorageState::zero; }
+    void sync(const void * /*p*/, size_t /*nbytes*/) {}
+    void storeState(bool /*nonzero*/) {}
+
+    HugePageStorage selectOnCopy() const { return HugePageStorage(_flags); }
+
+private:
+    unsigned _flags;
+
+    static size_t _mapLength(const size_t nbytes) { return (nbytes + huge_page_size - 1) & ~(huge_page_size - 1); }
+};
+
+template <> struct storage_reuses_memory<MappedFileStorage>: std::true_type {}; // allocate() unmaps the previous mapping
+
+#endif // ONEWAY_STORAGE_MMAP
+
+
+#endif
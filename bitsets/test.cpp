@@ -1,4 +1,11 @@
 #include "OnewayBitset.hpp"
+#include "EpochBitset.hpp"
+#include "AtomicOnewayBitset.hpp"
+#include "CompressedOnewayBitset.hpp"
+#include "FixedOnewayBitset.hpp"
+#include "ShardedOnewayBitset.hpp"
+#include "CowOnewayBitset.hpp"
+#include "MultiOnewayBitset.hpp"
 #include "../change_tracking/tracking.hpp"
 #include "../common/Timer.hpp"
 #include "../common/benchtools.hpp"
@@ -10,6 +17,11 @@
 #include <algorithm>
 #include <functional>
 #include <cassert>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <sstream>
 
 using TestSizeT = uint64_t;
 using TestAllocT = uint8_t;
@@ -68,10 +80,1058 @@ void checkBitsetArrayWise(const TestBF &bitset, const bool refBits[])
     assertBitsEqual(bitset.getNBits(), testBits, refBits);
 }
 
+void checkBitsetIndexWise(const TestBF &bitset, const bool refBits[])
+{   // set bit iteration (callback and iterator) must visit exactly the true refBits, in order
+    std::vector<TestSizeT> refIndices, cbIndices, itIndices;
+    for (TestSizeT i=0; i<bitset.getNBits(); ++i) {
+        if (refBits[i]) { refIndices.push_back(i); }
+    }
+    bitset.forEachSet([&cbIndices](const TestSizeT i) { cbIndices.push_back(i); });
+    for (const TestSizeT i : bitset.setBits()) { itIndices.push_back(i); }
+    assert(cbIndices == refIndices);
+    assert(itIndices == refIndices);
+}
+
 void checkBitset(const TestBF &bitset, const bool refBits[])
 {
     checkBitsetElementWise(bitset, refBits);
     checkBitsetArrayWise(bitset, refBits);
+    checkBitsetIndexWise(bitset, refBits);
+}
+
+
+void checkBlockKernels()
+{   // compare every kernel set supported by this CPU against the scalar fallback
+    using namespace blockkernels;
+    const size_t sizes[] = {0, 1, 7, 8, 31, 63, 64, 65, 127, 255, 256, 1000, 8191, 8200};
+    uint64_t rng = 12345;
+    auto nextByte = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return static_cast<unsigned char>(rng >> 56); };
+
+    for (const Isa isa : {Isa::scalar, Isa::avx2, Isa::avx512}) {
+        if (forceIsa(isa) != isa) { continue; } // not supported here
+        for (const size_t n : sizes) {
+            std::vector<unsigned char> a(n), b(n), c(n);
+            for (size_t i=0; i<n; ++i) { a[i] = nextByte(); b[i] = nextByte(); }
+
+            assert(kernels().popcount(a.data(), n) == popcountScalar(a.data(), n));
+            assert(popcountStream(a.data(), n) == popcountScalar(a.data(), n));
+
+            for (const size_t offset : {size_t(0), size_t(1), size_t(33)}) { // non-temporal fill of unaligned ranges, with guard bytes
+                std::vector<unsigned char> filled(n+offset+1, 0xAA);
+                kernels().fillStream(filled.data()+offset, 0x5C, n);
+                for (size_t i=0; i<filled.size(); ++i) { assert(filled[i] == ((i >= offset && i < offset+n) ? 0x5C : 0xAA)); }
+            }
+
+            std::vector<unsigned char> expanded(8*n+1, 0xAA); // one guard byte
+            kernels().expandBits(a.data(), expanded.data(), n);
+            for (size_t i=0; i<8*n; ++i) { assert(expanded[i] == ((a[i/8] >> (i%8)) & 1)); }
+            assert(expanded[8*n] == 0xAA);
+            std::vector<unsigned char> expanded2(8*n, 0xAA);
+            expandBitsStream(a.data(), expanded2.data(), n);
+            assert(std::equal(expanded2.begin(), expanded2.end(), expanded.begin()));
+
+            c = a;
+            kernels().orInto(c.data(), b.data(), n);
+            for (size_t i=0; i<n; ++i) { assert(c[i] == (a[i] | b[i])); }
+            std::vector<unsigned char> c2(a);
+            assert(kernels().orIntoCount(c2.data(), b.data(), n) == popcountScalar(c.data(), n) && c2 == c);
+
+            std::vector<unsigned char> d(n), e(n);
+            for (size_t i=0; i<n; ++i) { d[i] = nextByte() & nextByte(); e[i] = nextByte() & nextByte(); }
+            const unsigned char * srcs[3] = {a.data(), b.data(), d.data()};
+            c = e;
+            kernels().orManyInto(c.data(), srcs, 3, n);
+            for (size_t i=0; i<n; ++i) { assert(c[i] == (a[i] | b[i] | d[i] | e[i])); }
+            kernels().orManyTo(c.data(), srcs, 3, n);
+            for (size_t i=0; i<n; ++i) { assert(c[i] == (a[i] | b[i] | d[i])); }
+
+            uint64_t refAnd = 0, refOr = 0, refAndNot = 0;
+            for (size_t i=0; i<n; ++i) {
+                refAnd += popcount64(a[i] & b[i]);
+                refOr += popcount64(a[i] | b[i]);
+                refAndNot += popcount64(a[i] & ~b[i] & 0xFF);
+            }
+            assert(kernels().popcountAnd(a.data(), b.data(), n) == refAnd);
+            assert(kernels().popcountOr(a.data(), b.data(), n) == refOr);
+            assert(kernels().popcountAndNot(a.data(), b.data(), n) == refAndNot);
+            assert(kernels().anyAnd(a.data(), b.data(), n) == (refAnd > 0));
+            assert(kernels().anyAndNot(a.data(), b.data(), n) == (refAndNot > 0));
+            assert(!kernels().anyAndNot(a.data(), a.data(), n));
+
+            assert(kernels().equal(a.data(), a.data(), n) && equalStream(a.data(), a.data(), n));
+            c = a;
+            if (n > 0) { c[n-1] ^= 1; assert(!kernels().equal(a.data(), c.data(), n) && !equalStream(a.data(), c.data(), n)); }
+
+            std::fill(c.begin(), c.end(), 0xFF);
+            assert(kernels().allOnes(c.data(), n));
+            assert(kernels().popcount(c.data(), n) == 8*n);
+            assert(allOnesStream(c.data(), n) && popcountStream(c.data(), n) == 8*n);
+            if (n > 0) { c[n/2] = 0x7F; assert(!kernels().allOnes(c.data(), n) && !allOnesStream(c.data(), n)); }
+
+            std::fill(c.begin(), c.end(), 0);
+            assert(kernels().findNonzero(c.data(), n) == n);
+            for (const size_t pos : {size_t(0), n/3, n/2, n-1}) {
+                if (pos >= n) { continue; }
+                c[pos] = 0x10;
+                assert(kernels().findNonzero(c.data(), n) == pos);
+                c[pos] = 0;
+            }
+            if (n > 0) {
+                c[n-1] = 1;
+                c[n/2] = 0x80;
+                assert(kernels().findNonzero(c.data(), n) == n/2);
+            }
+        }
+    }
+    forceIsa(detectIsa());
+}
+
+
+template <class BF>
+void checkSetBitsIterator(const BF &, const std::vector<bool> &) {} // only OnewayBitset provides setBits()
+
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT>
+void checkSetBitsIterator(const OnewayBitset<SizeT, AllocT, Opts, StorageT> &bitset, const std::vector<bool> &ref)
+{
+    TestSizeT itCount = 0, refCount = 0;
+    for (const TestSizeT i : bitset.setBits()) { assert(ref[i]); ++itCount; }
+    for (const bool b : ref) { refCount += b; }
+    assert(itCount == refCount);
+}
+
+template <class BF>
+void checkExports(const BF &, const std::vector<bool> &) {} // only OnewayBitset provides getIndices()
+
+template <typename SizeT, typename AllocT, unsigned Opts, typename StorageT>
+void checkExports(const OnewayBitset<SizeT, AllocT, Opts, StorageT> &bitset, const std::vector<bool> &ref)
+{
+    std::vector<char> out(ref.size()+1, 2); // one guard element
+    bitset.getAll(reinterpret_cast<bool *>(out.data()));
+    for (TestSizeT i=0; i<ref.size(); ++i) { assert(out[i] == static_cast<char>(ref[i])); }
+    assert(out[ref.size()] == 2);
+
+    std::vector<SizeT> indices(ref.size());
+    indices.resize(bitset.getIndices(indices.data()));
+    assert(indices.size() == static_cast<size_t>(std::count(ref.begin(), ref.end(), true)));
+    assert(std::is_sorted(indices.begin(), indices.end()));
+    for (const SizeT i : indices) { assert(ref[i]); }
+}
+
+template <class BF>
+void checkAgainstReference(const BF &bitset, const std::vector<bool> &ref)
+{   // compare any bitset variant against a std::vector<bool> reference
+    TestSizeT refCount = 0;
+    for (TestSizeT i=0; i<ref.size(); ++i) {
+        assert(bitset.get(i) == ref[i]);
+        refCount += ref[i];
+    }
+    assert(static_cast<TestSizeT>(bitset.count()) == refCount);
+    assert(bitset.any() == (refCount > 0));
+
+    std::vector<TestSizeT> indices;
+    bitset.forEachSet([&indices](const TestSizeT i) { indices.push_back(i); });
+    assert(static_cast<TestSizeT>(indices.size()) == refCount);
+    for (const TestSizeT i : indices) { assert(ref[i]); }
+    checkSetBitsIterator(bitset, ref);
+    checkExports(bitset, ref);
+}
+
+template <class BF>
+void checkVariant(const std::string &label)
+{   // randomized set/merge/reset/setAll sequence on various sizes and densities
+    std::cout << "Checking variant " << label << "..." << std::endl;
+    uint64_t rng = 4242;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+
+    for (const TestSizeT nbits : {1UL, 17UL, 64UL, 100UL, 4099UL, 70001UL}) {
+        for (const TestSizeT nset : {0UL, 1UL, 5UL, nbits/10, nbits}) {
+            BF bitset1(nbits), bitset2(nbits);
+            std::vector<bool> ref1(nbits, false), ref2(nbits, false);
+            for (TestSizeT k=0; k<nset; ++k) {
+                const TestSizeT i = nextRand() % nbits, j = nextRand() % nbits;
+                bitset1.set(i); ref1[i] = true;
+                bitset2.set(j); ref2[j] = true;
+            }
+            checkAgainstReference(bitset1, ref1);
+            checkAgainstReference(bitset2, ref2);
+
+            bitset1.merge(bitset2);
+            for (TestSizeT i=0; i<nbits; ++i) { ref1[i] = ref1[i] || ref2[i]; }
+            checkAgainstReference(bitset1, ref1);
+
+            BF bitset3(bitset1);
+            assert(bitset3 == bitset1);
+            checkAgainstReference(bitset3, ref1);
+
+            bitset1.reset();
+            std::fill(ref1.begin(), ref1.end(), false);
+            checkAgainstReference(bitset1, ref1);
+            assert(!bitset1.all());
+
+            bitset1.set(nbits-1); ref1[nbits-1] = true; // sets after reset must work as usual
+            checkAgainstReference(bitset1, ref1);
+
+            bitset3.setAll();
+            assert(bitset3.all() && static_cast<TestSizeT>(bitset3.count()) == nbits);
+            bitset3.reset();
+            checkAgainstReference(bitset3, std::vector<bool>(nbits, false));
+            bitset3 = bitset2;
+            checkAgainstReference(bitset3, ref2);
+        }
+    }
+    std::cout << "Done." << std::endl;
+}
+
+void checkCompressedContainers()
+{   // container conversions of CompressedOnewayBitset (array -> bitmap, runOptimize, run merges)
+    std::cout << "Checking compressed containers..." << std::endl;
+    using CBF = CompressedOnewayBitset<TestSizeT>;
+    using Container = CBF::Container;
+    const TestSizeT nbits = 5*65536 + 123;
+    CBF bitset1(nbits), bitset2(nbits);
+    std::vector<bool> ref1(nbits, false), ref2(nbits, false);
+
+    for (TestSizeT i=0; i<65536; i+=2) { bitset1.set(i); ref1[i] = true; } // chunk 0: array -> bitmap
+    for (TestSizeT i=65536+100; i<65536+30000; ++i) { bitset1.set(i); ref1[i] = true; } // chunk 1: one long run
+    for (TestSizeT i=2*65536; i<2*65536+50; i+=7) { bitset1.set(i); ref1[i] = true; } // chunk 2: sparse
+    for (TestSizeT i=5*65536; i<nbits; i+=3) { bitset1.set(i); ref1[i] = true; } // partial last chunk
+    assert(bitset1.getContainer(0)->type == Container::bitmap);
+    assert(bitset1.getContainer(3) == nullptr);
+    checkAgainstReference(bitset1, ref1);
+
+    const CBF unoptimized(bitset1);
+    const size_t bytesBefore = bitset1.memoryBytes();
+    bitset1.runOptimize();
+    assert(bitset1.getContainer(0)->type == Container::bitmap);
+    assert(bitset1.getContainer(1)->type == Container::run);
+    assert(bitset1.getContainer(2)->type == Container::array);
+    assert(bitset1.memoryBytes() < bytesBefore);
+    assert(bitset1 == unoptimized);
+    checkAgainstReference(bitset1, ref1);
+
+    for (TestSizeT i=65536+20000; i<65536+40000; i+=2) { bitset2.set(i); ref2[i] = true; } // overlaps the run
+    for (TestSizeT i=3*65536+5; i<3*65536+9; ++i) { bitset2.set(i); ref2[i] = true; }
+    bitset2.runOptimize();
+    bitset2.set(3*65536+4); ref2[3*65536+4] = true; // extend run at front
+    bitset2.set(3*65536+11); ref2[3*65536+11] = true; // new run
+    bitset2.set(3*65536+10); ref2[3*65536+10] = true; // close gap between runs
+    bitset2.set(3*65536+9); ref2[3*65536+9] = true;
+    assert(bitset2.getContainer(3)->type == Container::run && bitset2.getContainer(3)->nruns() == 1);
+    checkAgainstReference(bitset2, ref2);
+
+    bitset1.merge(bitset2); // run | bitmap, and chunks only present in bitset2
+    for (TestSizeT i=0; i<nbits; ++i) { ref1[i] = ref1[i] || ref2[i]; }
+    checkAgainstReference(bitset1, ref1);
+
+    CBF bitset3(nbits), bitset4(nbits); // run | run
+    bitset3.setAll();
+    bitset4.set(17);
+    bitset4.runOptimize();
+    bitset4.merge(bitset3);
+    assert(bitset4.all() && bitset4.getContainer(0)->type == Container::run);
+    assert(bitset4 == bitset3);
+
+    // the running count that any()/none()/count() use, through repeated sets, moves and reset
+    const TestSizeT count1 = bitset1.count();
+    bitset1.set(0); bitset1.set(65536+200); bitset1.set(3*65536+9); // already set (bitmap, run, run)
+    assert(bitset1.count() == count1);
+    CBF moved(std::move(bitset1));
+    assert(moved.count() == count1 && moved.any() && bitset1.none() && bitset1.count() == 0);
+    bitset1 = std::move(moved);
+    assert(bitset1.count() == count1);
+    CBF bitset5(nbits);
+    assert(bitset5.none() && !bitset5.any());
+    bitset5.merge(bitset5); // empty | empty
+    assert(bitset5.none());
+    bitset5.set(4*65536+1);
+    assert(bitset5.any() && bitset5.count() == 1 && bitset5 != CBF(nbits));
+    bitset5.reset();
+    assert(bitset5.none() && bitset5.count() == 0 && bitset5 == CBF(nbits));
+    std::cout << "Done." << std::endl;
+}
+
+template <size_t N, typename AllocT>
+void checkFixedBitset()
+{   // FixedOnewayBitset against reference and against OnewayBitset of same size
+    using FBF = FixedOnewayBitset<N, AllocT>;
+    static_assert(FBF::getNBlocks()*FBF::blocksize >= N && (FBF::getNBlocks()-1)*FBF::blocksize < N, "wrong block count");
+    static_assert(alignof(FBF) == 64, "blocks not cache line aligned");
+    uint64_t rng = 777;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+
+    FBF bitset1, bitset2;
+    OnewayBitset<TestSizeT, AllocT> dyn1(N);
+    std::vector<bool> ref1(N, false), ref2(N, false);
+    checkAgainstReference(bitset1, ref1);
+    assert(bitset1.none() && !bitset1.all());
+    for (size_t k=0; k<N/3+1; ++k) {
+        const size_t i = nextRand() % N, j = nextRand() % N;
+        bitset1.set(i); dyn1.set(i); ref1[i] = true;
+        bitset2.set(j/FBF::blocksize, j%FBF::blocksize); ref2[j] = true;
+    }
+    checkAgainstReference(bitset1, ref1);
+    checkAgainstReference(bitset2, ref2);
+    assert(static_cast<TestSizeT>(bitset1.count()) == dyn1.count());
+    assert(std::equal(bitset1.getBlocks(), bitset1.getBlocks()+FBF::getNBlocks(), dyn1.getBlocks()));
+
+    const FBF bitset3 = bitset1 + bitset2;
+    bitset1 += bitset2;
+    for (size_t i=0; i<N; ++i) { ref1[i] = ref1[i] || ref2[i]; }
+    checkAgainstReference(bitset1, ref1);
+    assert(bitset3 == bitset1);
+
+    bool out[N];
+    bitset1.getAll(out);
+    for (size_t i=0; i<N; ++i) { assert(out[i] == ref1[i]); }
+
+    bitset1.setAll();
+    assert(bitset1.all() && bitset1.count() == N && bitset1.getBlocks()[FBF::getNBlocks()-1] == FBF::padblk);
+    bitset1.reset();
+    checkAgainstReference(bitset1, std::vector<bool>(N, false));
+}
+
+template <class BF>
+void checkBulkSetters(const std::string &label)
+{   // setRange, setStrided, setIndices and setBlockMask against per-bit set()
+    std::cout << "Checking bulk setters " << label << "..." << std::endl;
+    for (const TestSizeT nbits : {1UL, 17UL, 64UL, 100UL, 4099UL, 70001UL}) {
+        std::vector<TestSizeT> points = {0, 1, 7, 8, 63, 64, 65, nbits/3, nbits/2, nbits-2, nbits-1, nbits};
+        points.erase(std::remove_if(points.begin(), points.end(), [nbits](const TestSizeT p) { return p > nbits; }), points.end());
+        for (const TestSizeT first : points) {
+            for (const TestSizeT last : points) {
+                if (last < first) { continue; }
+                BF bitset(nbits);
+                std::vector<bool> ref(nbits, false);
+                bitset.setRange(first, last);
+                for (TestSizeT i=first; i<last; ++i) { ref[i] = true; }
+                checkAgainstReference(bitset, ref);
+            }
+        }
+        for (const TestSizeT first : points) {
+            if (first >= nbits) { continue; }
+            for (const TestSizeT step : {1UL, 2UL, 3UL, 5UL, 7UL, 8UL, 13UL, 31UL, 63UL, 64UL, 65UL, 997UL}) {
+                BF bitset(nbits);
+                std::vector<bool> ref(nbits, false);
+                bitset.setStrided(first, step);
+                for (TestSizeT i=first; i<nbits; i+=step) { ref[i] = true; }
+                checkAgainstReference(bitset, ref);
+            }
+        }
+        uint64_t rng = 99;
+        std::vector<TestSizeT> indices;
+        for (TestSizeT k=0; k<nbits/5+1; ++k) { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; indices.push_back((rng >> 33) % nbits); }
+        BF unsorted(nbits), sorted(nbits);
+        std::vector<bool> ref(nbits, false);
+        for (const TestSizeT i : indices) { ref[i] = true; }
+        unsorted.setIndices(indices.begin(), indices.end());
+        std::sort(indices.begin(), indices.end());
+        sorted.setIndices(indices.data(), indices.data()+indices.size());
+        checkAgainstReference(unsorted, ref);
+        checkAgainstReference(sorted, ref);
+        sorted.setIndices(indices.begin(), indices.begin()); // empty batch
+        assert(sorted == unsorted);
+
+        BF blocked(nbits), perbit(nbits);
+        std::vector<bool> blockedRef(nbits, false);
+        blocked.setBlockMask(0, 0); // empty mask
+        assert(blocked.none());
+        for (int pass=0; pass<2; ++pass) { // the second pass sets some bits again
+            for (TestSizeT blk=0; blk<blocked.getNBlocks(); blk+=2) {
+                rng = rng*6364136223846793005ULL + 1442695040888963407ULL;
+                TestAllocT mask = static_cast<TestAllocT>(rng >> 17);
+                if (blk == blocked.getNBlocks()-1) { mask &= blocked.getPadBlock(); }
+                blocked.setBlockMask(blk, mask);
+                for (TestSizeT j=0; j<BF::blocksize; ++j) {
+                    if ((mask >> j) & 1) { perbit.set(blk*BF::blocksize + j); blockedRef[blk*BF::blocksize + j] = true; }
+                }
+            }
+            checkAgainstReference(blocked, blockedRef);
+            assert(blocked == perbit);
+        }
+        blocked.reset(); // has to clear the blocks set by mask (i.e. they must be in the dirty list)
+        assert(blocked.none() && blocked.count() == 0);
+        checkAgainstReference(blocked, std::vector<bool>(nbits, false));
+        blocked.setBlockMask(blocked.getNBlocks()-1, blocked.getPadBlock()); // all bits of the last block
+        std::vector<bool> lastRef(nbits, false);
+        std::fill(lastRef.begin() + (blocked.getNBlocks()-1)*BF::blocksize, lastRef.end(), true);
+        checkAgainstReference(blocked, lastRef);
+    }
+    std::cout << "Done." << std::endl;
+}
+
+template <class BF>
+void checkMergeAll(const std::string &label)
+{   // N-way mergeAll against pairwise merges (more sources than one batch, plus empty and mismatching ones)
+    std::cout << "Checking mergeAll " << label << "..." << std::endl;
+    for (const TestSizeT nbits : {1UL, 100UL, 70001UL}) {
+        const size_t nsrcs = 2*BF::mergeall_batch + 3;
+        std::vector<BF> srcs;
+        for (size_t k=0; k<nsrcs; ++k) {
+            srcs.emplace_back(nbits);
+            if (k%7 != 3) { srcs.back().setStrided(k % nbits, 2*k+1); } // some stay empty
+        }
+        BF wrongSize(nbits+1);
+        wrongSize.setAll();
+        std::vector<const BF *> ptrs;
+        for (const BF &src : srcs) { ptrs.push_back(&src); }
+        ptrs.push_back(&wrongSize);
+
+        BF expected(nbits), result(nbits);
+        expected.set(nbits/2);
+        result.set(nbits/2);
+        for (const BF &src : srcs) { expected.merge(src); }
+        result.mergeAll(ptrs.data(), ptrs.size());
+        assert(result == expected && result.count() == expected.count());
+
+        BF none(nbits);
+        none.mergeAll(ptrs.data(), 0);
+        none.mergeAll(ptrs.data()+3, 1); // empty source
+        assert(none.none());
+    }
+    std::cout << "Done." << std::endl;
+}
+
+template <class BF>
+void checkSetAlgebra(const std::string &label)
+{   // fused set queries against reference
+    std::cout << "Checking set algebra " << label << "..." << std::endl;
+    uint64_t rng = 31337;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+
+    for (const TestSizeT nbits : {1UL, 17UL, 64UL, 100UL, 4099UL, 70001UL}) {
+        for (const TestSizeT nset : {0UL, 1UL, nbits/10, nbits}) {
+            BF bitset1(nbits), bitset2(nbits);
+            std::vector<bool> ref1(nbits, false), ref2(nbits, false);
+            for (TestSizeT k=0; k<nset; ++k) {
+                const TestSizeT i = nextRand() % nbits, j = nextRand() % nbits;
+                bitset1.set(i); ref1[i] = true;
+                bitset2.set(j); ref2[j] = true;
+            }
+            TestSizeT refAnd = 0, refOr = 0, refAndNot = 0;
+            for (TestSizeT i=0; i<nbits; ++i) {
+                refAnd += (ref1[i] && ref2[i]);
+                refOr += (ref1[i] || ref2[i]);
+                refAndNot += (ref1[i] && !ref2[i]);
+            }
+            assert(static_cast<TestSizeT>(bitset1.countIntersection(bitset2)) == refAnd);
+            assert(static_cast<TestSizeT>(bitset1.countUnion(bitset2)) == refOr);
+            assert(static_cast<TestSizeT>(bitset1.countAndNot(bitset2)) == refAndNot);
+            assert(bitset1.intersects(bitset2) == (refAnd > 0));
+            assert(bitset1.isSubsetOf(bitset2) == (refAndNot == 0));
+            assert(bitset1.isSubsetOf(bitset1 + bitset2) && bitset2.isSubsetOf(bitset1 + bitset2));
+            assert(bitset1.countUnion(bitset2) == (bitset1 + bitset2).count());
+        }
+    }
+    std::cout << "Done." << std::endl;
+}
+
+template <class BF>
+void checkExpressions(const std::string &label)
+{   // lazy operator+ expressions against eager merges
+    std::cout << "Checking expressions " << label << "..." << std::endl;
+    for (const TestSizeT nbits : {1UL, 100UL, 70001UL}) {
+        BF a(nbits), b(nbits), c(nbits), d(nbits), empty(nbits);
+        a.setStrided(0, 3);
+        b.setStrided(1, 5);
+        c.set(nbits/2);
+        d.setStrided(nbits/3, 7);
+        BF expected(a);
+        expected.merge(b);
+        expected.merge(c);
+
+        const BF constructed = a + b + c;
+        assert(constructed == expected);
+        assert(BF(c + (a + b)) == expected);
+        assert(static_cast<TestSizeT>((a + b + c).count()) == expected.count());
+        assert(static_cast<TestSizeT>((a + b).count()) == (a + b + empty).count());
+
+        BF assigned(nbits);
+        assigned.set(0); // must be overwritten
+        assigned = b + c + empty + a;
+        assert(assigned == expected);
+        assigned = empty + empty;
+        assert(assigned.none());
+
+        BF withD(expected);
+        withD.merge(d);
+        BF inplace(a);
+        inplace = b + inplace + (c + d); // this is an operand
+        assert(inplace == withD);
+        inplace = empty + a;
+        assert(inplace == a);
+        inplace += b + c + d;
+        assert(inplace == withD);
+
+        BF resized(nbits+5);
+        resized.setAll();
+        resized = a + b + c;
+        assert(resized.getNBits() == nbits && resized == expected);
+        BF wrongSize(nbits+1);
+        wrongSize.setAll();
+        assigned = a + b + wrongSize + c; // operands of different size are ignored (like in merge)
+        assert(assigned == expected);
+        assert((a + wrongSize).count() == BF(a + wrongSize).count() && (a + wrongSize).count() == a.count());
+        assert((wrongSize + a).count() == BF(wrongSize + a).count() && (wrongSize + a).count() == wrongSize.count());
+        BF target(a); // the target is an operand of another size than the first
+        target = wrongSize + target;
+        assert(target.getNBits() == nbits+1 && target == wrongSize && target.count() == wrongSize.count());
+        BF emptyWrongSize(nbits+1);
+        target = a;
+        target = emptyWrongSize + target;
+        assert(target.getNBits() == nbits+1 && target.none() && target.count() == 0 && target == emptyWrongSize);
+    }
+    std::cout << "Done." << std::endl;
+}
+
+template <class BF>
+void checkFindRankSelect(const std::string &label)
+{   // findFirst/findNext, rank/select (with and without RankIndex) against a reference
+    std::cout << "Checking find/rank/select " << label << "..." << std::endl;
+    uint64_t rng = 777;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+
+    for (const TestSizeT nbits : {1UL, 64UL, 100UL, 4096UL, 70001UL}) {
+        for (const TestSizeT nset : {0UL, 1UL, 7UL, nbits/50, nbits}) {
+            BF bitset(nbits);
+            std::vector<bool> ref(nbits, false);
+            for (TestSizeT k=0; k<nset; ++k) {
+                const TestSizeT i = (k % 3 == 0) ? nbits-1-k%nbits : nextRand() % nbits; // some at the end
+                bitset.set(i); ref[i] = true;
+            }
+            std::vector<TestSizeT> setIdx, rankRef(nbits+1, 0);
+            for (TestSizeT i=0; i<nbits; ++i) {
+                if (ref[i]) { setIdx.push_back(i); }
+                rankRef[i+1] = static_cast<TestSizeT>(setIdx.size());
+            }
+            const typename BF::RankIndex index(bitset);
+            assert(index.count() == static_cast<TestSizeT>(setIdx.size()));
+
+            TestSizeT pos = bitset.findFirst();
+            for (const TestSizeT i : setIdx) { assert(pos == i); pos = bitset.findNext(pos); }
+            assert(pos == BF::npos);
+            for (TestSizeT k=0; k<100; ++k) { // findNext from arbitrary positions
+                const TestSizeT from = nextRand() % nbits;
+                const auto it = std::upper_bound(setIdx.begin(), setIdx.end(), from);
+                assert(bitset.findNext(from) == (it == setIdx.end() ? BF::npos : *it));
+            }
+
+            for (TestSizeT i=0; i<=nbits; i+=(nbits > 5000 ? 37 : 1)) {
+                assert(bitset.rank(i) == rankRef[i] && index.rank(i) == rankRef[i]);
+            }
+            assert(bitset.rank(nbits) == rankRef[nbits] && index.rank(nbits) == rankRef[nbits]);
+            for (size_t k=0; k<setIdx.size(); k+=(setIdx.size() > 5000 ? 29 : 1)) {
+                assert(bitset.select(static_cast<TestSizeT>(k)) == setIdx[k] && index.select(static_cast<TestSizeT>(k)) == setIdx[k]);
+            }
+            if (!setIdx.empty()) {
+                assert(bitset.select(static_cast<TestSizeT>(setIdx.size()-1)) == setIdx.back());
+                assert(index.select(static_cast<TestSizeT>(setIdx.size()-1)) == setIdx.back());
+            }
+            assert(bitset.select(static_cast<TestSizeT>(setIdx.size())) == BF::npos && index.select(static_cast<TestSizeT>(setIdx.size())) == BF::npos);
+        }
+    }
+    std::cout << "Done." << std::endl;
+}
+
+template <class BF>
+void checkMoveAndCapacity(const std::string &label)
+{   // move/swap steal the blocks, smaller assignments keep the capacity
+    std::cout << "Checking move and capacity " << label << "..." << std::endl;
+    const TestSizeT nbits = 70001;
+    BF a(nbits), b(nbits/2);
+    a.setStrided(0, 3);
+    b.setStrided(1, 5);
+    const BF refA(a), refB(b);
+
+    const auto * const blocksA = a.getBlocks();
+    BF moved(std::move(a));
+    assert(moved == refA && moved.getBlocks() == blocksA);
+    assert(a.getNBits() == 0 && a.none() && a.getBlocks() == nullptr);
+    a = refA; // moved-from objects can be assigned to
+    assert(a == refA);
+
+    swap(moved, b);
+    assert(moved == refB && b == refA && b.getBlocks() == blocksA);
+    b.swap(moved);
+    assert(b == refB && moved == refA);
+
+    BF reused(refA);
+    const TestSizeT cap = reused.capacity();
+    assert(cap >= nbits);
+    reused = refB; // smaller, no reallocation
+    assert(reused == refB && reused.capacity() == cap && reused.count() == refB.count());
+    reused.set(nbits/2 - 1);
+    assert(reused.get(nbits/2 - 1) && !refB.get(nbits/2 - 1));
+    reused = refA + refA; // back to the full size, still no reallocation
+    assert(reused == refA && reused.capacity() == cap);
+    reused = refB + refB;
+    reused.shrink_to_fit();
+    assert(reused == refB && reused.capacity() < cap && reused.capacity() >= nbits/2);
+    reused.reset();
+    assert(reused.none());
+    reused.setAll();
+    assert(reused.all() && reused.count() == nbits/2);
+    std::cout << "Done." << std::endl;
+}
+
+void checkEpochWrapAround()
+{   // with an 8 bit generation counter, the stamps get cleared every 255 resets
+    EpochBitset<TestSizeT, TestAllocT, uint8_t> bitset(100);
+    for (int step=0; step<1000; ++step) {
+        bitset.set(step % 100);
+        bitset.set(99 - step % 37);
+        assert(bitset.get(step % 100));
+        assert(bitset.count() == (step % 100 == 99 - step % 37 ? 1u : 2u));
+        bitset.reset();
+        assert(bitset.count() == 0);
+        assert(!bitset.get(step % 100));
+    }
+}
+
+void checkAtomicConcurrentSet()
+{   // threads set overlapping strided patterns, the union must be exact
+    const TestSizeT nbits = 100003;
+    const int nthreads = 4;
+    AtomicOnewayBitset<TestSizeT, TestAllocT> shared(nbits);
+    OnewayBitset<TestSizeT, TestAllocT> expected(nbits), local(nbits);
+    assert(shared.none() && shared.count() == 0);
+
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; ++t) {
+        threads.emplace_back([&shared, t, nbits]() {
+            for (TestSizeT i=t; i<nbits; i+=2*t+3) { shared.set(i); }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+    for (int t=0; t<nthreads; ++t) {
+        for (TestSizeT i=t; i<nbits; i+=2*t+3) { expected.set(i); }
+    }
+    assert(shared.any());
+    assert(shared.equals(expected));
+    assert(shared.count() == expected.count());
+
+    local.set(nbits-1);
+    local.set(1);
+    shared.merge(local);
+    expected.merge(local);
+    assert(shared.equals(expected));
+
+    shared.reset();
+    assert(shared.none() && shared.count() == 0);
+    shared.setAll();
+    assert(shared.count() == nbits);
+}
+
+void checkParallelOps()
+{   // parallel reset/count/merge must agree with the sequential versions
+    ThreadPool pool(3);
+#ifdef __linux__
+    { // workers are pinned within the affinity mask of the process (one CPU each), never outside
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        assert(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0);
+        std::vector<int> inside(static_cast<size_t>(pool.size()), 0);
+        pool.run([&allowed, &inside, &pool](const int t) {
+            cpu_set_t mine, both;
+            CPU_ZERO(&mine);
+            pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &mine);
+            CPU_AND(&both, &mine, &allowed);
+            inside[t] = CPU_EQUAL(&both, &mine) && (!pool.isPinned() || CPU_COUNT(&mine) == 1);
+        });
+        assert(std::all_of(inside.begin(), inside.end(), [](const int ok) { return ok != 0; }));
+    }
+#endif
+    for (const TestSizeT nbits : {1UL, 100UL, 1000UL, 123457UL}) {
+        TestBF bitset1(nbits, pool), bitset2(nbits), bitset3(nbits);
+        assert(bitset1.none() && bitset1.count(pool) == 0);
+        for (TestSizeT i=0; i<nbits; i+=7) { bitset1.set(i); bitset3.set(i); }
+        for (TestSizeT i=nbits/2; i<nbits; i+=3) { bitset2.set(i); bitset3.set(i); }
+        assert(bitset1.count(pool) == bitset1.count());
+
+        bitset1.merge(bitset2, pool);
+        assert(bitset1 == bitset3);
+        assert(bitset1.count(pool) == bitset3.count());
+
+        TestBF bitset4(nbits);
+        const TestBF * const others[] = {&bitset2, &bitset1, &bitset2};
+        bitset4.mergeAll(others, 3, pool);
+        assert(bitset4 == bitset3);
+
+        bitset1.reset(pool);
+        assert(bitset1.none() && bitset1.count() == 0 && bitset1.count(pool) == 0);
+        bitset1.merge(TestBF(nbits), pool); // merging zeros keeps the flag
+        assert(bitset1.none());
+
+        OnewayBitset<TestSizeT, TestAllocT, onewayopt::streaming> streamed(nbits, pool); // non-temporal fill per worker
+        streamed.setAll();
+        streamed.reset(pool);
+        streamed.set(nbits-1);
+        assert(streamed.count() == 1 && streamed.count(pool) == 1);
+    }
+}
+
+void checkSnapshots()
+{   // snapshots of CowOnewayBitset must not change with the original, and share the unmodified chunks
+    std::cout << "Checking snapshots..." << std::endl;
+    using CBF = CowOnewayBitset<TestSizeT, TestAllocT, 64>; // 512 bits per chunk
+    const TestSizeT nbits = 100*512 + 77;
+    CBF live(nbits);
+    std::vector<bool> ref(nbits, false);
+    std::vector<CBF> snapshots;
+    std::vector<std::vector<bool>> refs;
+    uint64_t rng = 99;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+
+    for (int step=0; step<10; ++step) {
+        snapshots.push_back(live.snapshot());
+        refs.push_back(ref);
+        assert(live.getNSharedChunks() == live.getNAllocatedChunks()); // everything shared right after the snapshot
+        for (int k=0; k<5; ++k) {
+            const TestSizeT i = nextRand() % nbits;
+            live.set(i); ref[i] = true;
+        }
+        assert(live.getNAllocatedChunks() - live.getNSharedChunks() <= 5); // only the written chunks were cloned
+    }
+    checkAgainstReference(live, ref);
+    for (size_t s=0; s<snapshots.size(); ++s) { checkAgainstReference(snapshots[s], refs[s]); }
+
+    CBF other(nbits);
+    for (TestSizeT i=0; i<512; i+=3) { other.set(i); }
+    for (TestSizeT i=nbits-100; i<nbits; ++i) { other.set(i); }
+    CBF merged(snapshots[5]);
+    merged.merge(other);
+    std::vector<bool> mergedRef(refs[5]);
+    other.forEachSet([&mergedRef](const TestSizeT i) { mergedRef[i] = true; });
+    checkAgainstReference(merged, mergedRef);
+    checkAgainstReference(snapshots[5], refs[5]);
+    for (size_t c=1; c<99; ++c) { // chunks without bits of other stay shared with the snapshot
+        const bool allocated = std::any_of(refs[5].begin()+c*512, refs[5].begin()+(c+1)*512, [](const bool b) { return b; });
+        assert(merged.sharesChunk(snapshots[5], c) == allocated);
+    }
+
+    live.setAll();
+    assert(live.all() && static_cast<TestSizeT>(live.count()) == nbits);
+    live.reset();
+    assert(live.none() && live.getNAllocatedChunks() == 0);
+    for (size_t s=0; s<snapshots.size(); ++s) { checkAgainstReference(snapshots[s], refs[s]); }
+    std::cout << "Done." << std::endl;
+}
+
+void checkShardedBitset()
+{   // every worker sets interleaved bits in its own shard, the reductions must equal the union
+    std::cout << "Checking sharded bitset..." << std::endl;
+    ThreadPool pool(3);
+    for (const TestSizeT nbits : {1UL, 100UL, 4099UL, 123457UL}) {
+        ShardedOnewayBitset<TestSizeT, TestAllocT> sharded(nbits, pool), sequential(nbits, 5);
+        TestBF expected(nbits);
+        assert(sharded.getNShards() == pool.size() && sharded.getResult().none());
+        for (TestSizeT i=0; i<nbits; i+=5) { expected.set(i); }
+        pool.run([&sharded, nbits](const int t) {
+            for (TestSizeT i=static_cast<TestSizeT>(5*t); i<nbits; i+=static_cast<TestSizeT>(5*3)) { sharded.shard(t).set(i); }
+        });
+        for (TestSizeT i=0; i<nbits; i+=5) { sequential.shard(static_cast<int>(i % 5)).set(i); }
+        sharded.reduce(pool);
+        sequential.reduce();
+        for (TestSizeT i=0; i<nbits; ++i) { assert(sharded.getResult().get(i) == expected.get(i) && sequential.getResult().get(i) == expected.get(i)); }
+        assert(sharded.getResult().count() == expected.count());
+
+        sharded.resetShards(pool);
+        sharded.shard(1).set(nbits-1);
+        sharded.reduce(pool); // accumulates into the result
+        assert(sharded.getResult().count() == expected.count() + (expected.get(nbits-1) ? 0 : 1));
+        sharded.reset(pool);
+        sequential.reset();
+        assert(sharded.getResult().none() && sharded.shard(1).none() && sequential.getResult().none());
+    }
+    std::cout << "Done." << std::endl;
+}
+
+void checkMultiMask()
+{   // every mask of MultiOnewayBitset must behave like its own OnewayBitset, and the row queries must agree with them
+    std::cout << "Checking multi-mask container..." << std::endl;
+    using MBF = MultiOnewayBitset<TestSizeT, TestAllocT>;
+    const TestSizeT bs = MBF::blocksize;
+    uint64_t rng = 4711;
+    auto nextRand = [&rng]() { rng = rng*6364136223846793005ULL + 1442695040888963407ULL; return rng >> 33; };
+    for (const TestSizeT nmasks : {1UL, 8UL, 70UL}) {
+        for (const TestSizeT nbits : {1UL, 100UL, 4099UL}) {
+            MBF multi(nbits, nmasks), other(nbits, nmasks);
+            std::vector<TestBF> refs(nmasks, TestBF(nbits));
+            assert(multi.getRowBlocks() == (nmasks+bs-1)/bs && multi.none() && multi.count() == 0);
+            for (int k=0; k<200; ++k) {
+                const TestSizeT mask = nextRand() % nmasks, i = nextRand() % nbits;
+                multi.set(mask, i); refs[mask].set(i);
+            }
+            std::vector<TestAllocT> row(multi.getRowBlocks(), 0);
+            for (TestSizeT k=0; k<nmasks; k+=3) { row[k/bs] |= static_cast<TestAllocT>(TestAllocT(1) << (k%bs)); }
+            other.setMasksAt(nbits/2, row.data());
+            other.setAllMasksAt(nbits-1);
+            for (TestSizeT k=0; k<nmasks; ++k) {
+                if (k%3 == 0) { refs[k].set(nbits/2); }
+                refs[k].set(nbits-1);
+            }
+            multi.merge(other);
+
+            TestBF merged(nbits), expectedMerged(nbits);
+            std::vector<TestAllocT> nonEmpty(multi.getRowBlocks(), 0);
+            multi.mergeMasks(merged);
+            multi.getNonEmptyMasks(nonEmpty.data());
+            TestSizeT total = 0;
+            for (TestSizeT k=0; k<nmasks; ++k) {
+                TestBF extracted(nbits);
+                multi.getMask(k, extracted);
+                assert(extracted == refs[k] && multi.countMask(k) == refs[k].count());
+                assert(((nonEmpty[k/bs] >> (k%bs)) & 1) == (refs[k].any() ? 1 : 0));
+                std::vector<TestSizeT> indices, refIndices;
+                multi.forEachSet(k, [&indices](const TestSizeT i) { indices.push_back(i); });
+                refs[k].forEachSet([&refIndices](const TestSizeT i) { refIndices.push_back(i); });
+                assert(indices == refIndices);
+                expectedMerged.merge(refs[k]);
+                total += refs[k].count();
+            }
+            assert(merged == expectedMerged && multi.count() == total);
+            for (TestSizeT i=0; i<nbits; ++i) {
+                std::vector<TestSizeT> masks;
+                multi.forEachMaskAt(i, [&masks](const TestSizeT k) { masks.push_back(k); });
+                assert(multi.anyAt(i) == !masks.empty() && multi.anyAt(i) == expectedMerged.get(i));
+                for (TestSizeT k=0, m=0; k<nmasks; ++k) {
+                    assert(multi.get(k, i) == refs[k].get(i));
+                    if (refs[k].get(i)) { assert(masks[m++] == k); }
+                }
+            }
+            other.merge(multi);
+            assert(multi == other);
+            multi.reset();
+            assert(multi.none() && multi.count() == 0 && !multi.anyAt(nbits-1));
+        }
+    }
+    std::cout << "Done." << std::endl;
+}
+
+void checkCounting()
+{   // the running count of onewayopt::counting must agree with a popcount after every kind of update
+    std::cout << "Checking counting..." << std::endl;
+    using BF = OnewayBitset<TestSizeT, TestAllocT>;
+    using CountingBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting>;
+    ThreadPool pool(3);
+    for (const TestSizeT nbits : {1UL, 100UL, 4099UL, 123457UL}) {
+        CountingBF counted(nbits), other(nbits);
+        BF plain(nbits);
+        for (TestSizeT i=0; i<nbits; i+=5) { counted.set(i); counted.set(i); plain.set(i); } // repeated sets count once
+        assert(counted.count() == plain.count());
+        for (TestSizeT i=nbits/3; i<nbits; i+=3) { other.set(i); plain.set(i); }
+        counted.merge(other, pool);
+        assert(counted.count() == plain.count() && counted.count(pool) == plain.count());
+        CountingBF merged(nbits);
+        const CountingBF * const sources[] = {&other, &counted};
+        merged.mergeAll(sources, 2, pool);
+        assert(merged.count() == plain.count());
+        counted.setRange(nbits/4, nbits/2);
+        plain.setRange(nbits/4, nbits/2);
+        assert(counted.count() == plain.count());
+
+        std::stringstream stream;
+        plain.write(stream);
+        CountingBF loaded(7);
+        loaded.set(3);
+        loaded.read(stream);
+        assert(loaded.count() == plain.count());
+
+        counted.reset(pool);
+        assert(counted.count() == 0);
+        counted = other + loaded;
+        assert(counted.count() == plain.count());
+        counted.setAll();
+        assert(counted.count() == nbits);
+    }
+    std::cout << "Done." << std::endl;
+}
+
+void checkAllocatorStorage()
+{   // aligned and huge page storage must deliver aligned blocks, also for copies and resizes
+    std::cout << "Checking aligned/huge page storage..." << std::endl;
+    using AlignedBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::none, AlignedStorage<>>;
+    using PageAlignedBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary, AlignedStorage<4096>>;
+    using HugeBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::none, HugePageStorage>;
+    auto offset = [](const void * p, const uintptr_t align) { return reinterpret_cast<uintptr_t>(p) % align; };
+
+    for (const TestSizeT nbits : {1UL, 4099UL, 20000001UL}) {
+        AlignedBF aligned(nbits);
+        PageAlignedBF pageAligned(nbits);
+        HugeBF huge(nbits), hugetlb(nbits, HugePageStorage(HugePageStorage::hugetlb)); // the latter may fall back to THP
+        assert(offset(aligned.getBlocks(), 64) == 0 && offset(pageAligned.getBlocks(), 4096) == 0);
+        assert(offset(huge.getBlocks(), HugePageStorage::huge_page_size) == 0 && offset(hugetlb.getBlocks(), 4096) == 0);
+        assert(aligned.none() && pageAligned.none() && huge.none() && hugetlb.none());
+
+        aligned.setStrided(0, 3);
+        pageAligned.setStrided(0, 3);
+        huge.setStrided(0, 3);
+        hugetlb.merge(huge);
+        const TestSizeT expected = (nbits+2)/3;
+        assert(aligned.count() == expected && pageAligned.count() == expected && huge.count() == expected && hugetlb == huge);
+
+        const AlignedBF alignedCopy(aligned);
+        const HugeBF hugeCopy(huge);
+        assert(offset(alignedCopy.getBlocks(), 64) == 0 && alignedCopy == aligned);
+        assert(offset(hugeCopy.getBlocks(), HugePageStorage::huge_page_size) == 0 && hugeCopy == huge);
+
+        huge = HugeBF(nbits+1000); // reallocation through the storage
+        huge.set(nbits);
+        assert(huge.count() == 1 && huge.get(nbits));
+    }
+    std::cout << "Done." << std::endl;
+}
+
+void checkMappedFileStorage()
+{   // bits must survive closing/reopening the file, copies must not write to the file
+    using MappedBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::none, MappedFileStorage>;
+    using MappedSummaryBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary, MappedFileStorage>;
+    const std::string path = "test_mapped.bin", crashpath = "test_mapped_crash.bin";
+    const TestSizeT nbits = 100000;
+    std::vector<bool> ref(nbits, false);
+    std::remove(path.c_str());
+
+    {
+        MappedBF bitset(nbits, MappedFileStorage(path));
+        assert(bitset.none() && bitset.count() == 0);
+        for (TestSizeT i=3; i<nbits; i+=101) { bitset.set(i); ref[i] = true; }
+        checkAgainstReference(bitset, ref);
+
+        MappedBF reader(nbits, MappedFileStorage(path, MappedFileStorage::readonly)); // shared mapping sees the writes
+        assert(reader.count() == bitset.count()); // (state is unknown while the writer is open, so reader scanned)
+
+        { // "crash" copy of the file while it is open
+            std::ifstream src(path, std::ios::binary);
+            std::ofstream dst(crashpath, std::ios::binary);
+            dst << src.rdbuf();
+        }
+        MappedBF copy(bitset); // anonymous memory
+        copy.set(0);
+        assert(!bitset.get(0));
+    }
+    {
+        MappedBF bitset(nbits, MappedFileStorage(path, MappedFileStorage::populate));
+        checkAgainstReference(bitset, ref);
+        bitset.reset();
+    }
+    {
+        MappedSummaryBF bitset(nbits, MappedFileStorage(crashpath)); // restored with unknown state
+        checkAgainstReference(bitset, ref);
+        bitset.reset();
+        checkAgainstReference(bitset, std::vector<bool>(nbits, false));
+    }
+    {
+        MappedBF bitset(nbits, MappedFileStorage(path));
+        assert(bitset.none() && bitset.count() == 0);
+    }
+    {
+        MappedBF resized(2*nbits, MappedFileStorage(path)); // size mismatch recreates the file
+        assert(resized.none() && resized.count() == 0);
+        MappedBF smaller(nbits, MappedFileStorage("")); // anonymous memory
+        for (TestSizeT i=3; i<nbits; i+=101) { smaller.set(i); }
+        resized = smaller; // keeps the capacity
+        resized.shrink_to_fit(); // remaps the file, content goes through a copy
+        assert(resized.capacity() < 2*nbits);
+        checkAgainstReference(resized, ref);
+    }
+    std::remove(path.c_str());
+    std::remove(crashpath.c_str());
+}
+
+void checkSerialization()
+{   // write/read round trips (also across AllocT and byte order), and zero-copy views of the format
+    std::cout << "Checking serialization..." << std::endl;
+    using BF = OnewayBitset<TestSizeT, TestAllocT>;
+    using SummaryBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary | onewayopt::dirtylist>;
+    using ViewBF = OnewayBitset<TestSizeT, TestAllocT, onewayopt::none, ViewStorage>;
+
+    for (const TestSizeT nbits : {0UL, 1UL, 17UL, 64UL, 70001UL}) {
+        BF bitset(nbits);
+        std::vector<bool> ref(nbits, false);
+        for (TestSizeT i=nbits/3; i<nbits; i+=7) { bitset.set(i); ref[i] = true; }
+        std::stringstream stream;
+        bitset.write(stream);
+        const std::string image = stream.str();
+        assert(image.size() == sizeof(onewayformat::Header) + bitset.getNBytes());
+
+        BF fresh, bigger(nbits+1000);
+        bigger.setAll();
+        std::istringstream in1(image), in2(image), in3(image);
+        fresh.read(in1);
+        bigger.read(in2);
+        assert(fresh == bitset && bigger == bitset);
+        SummaryBF summary(5);
+        summary.read(in3);
+        checkAgainstReference(summary, ref);
+        summary.reset();
+        assert(summary.none() && summary.count() == 0);
+
+        if (onewayformat::native_endian == onewayformat::little_endian) { // other block sizes
+            OnewayBitset<TestSizeT, uint8_t> narrow;
+            OnewayBitset<TestSizeT, uint64_t> wide;
+            std::istringstream in4(image);
+            narrow.read(in4);
+            checkAgainstReference(narrow, ref);
+            std::stringstream narrowStream;
+            narrow.write(narrowStream);
+            wide.read(narrowStream);
+            checkAgainstReference(wide, ref);
+        }
+
+        std::string foreign = image; // same bitset, written on a machine of the other byte order
+        onewayformat::Header header;
+        std::memcpy(&header, foreign.data(), sizeof(header));
+        header.endian = (header.endian == onewayformat::little_endian) ? onewayformat::big_endian : onewayformat::little_endian;
+        header.version = onewayformat::byteswap(header.version);
+        header.nbits = onewayformat::byteswap(header.nbits);
+        header.nbytes = onewayformat::byteswap(header.nbytes);
+        std::memcpy(&foreign[0], &header, sizeof(header));
+        for (size_t b=0; b<bitset.getNBlocks(); ++b) {
+            TestAllocT blk = bitset.getBlocks()[b];
+            blk = onewayformat::byteswap(blk);
+            std::memcpy(&foreign[sizeof(header) + b*sizeof(TestAllocT)], &blk, sizeof(blk));
+        }
+        std::istringstream in5(foreign);
+        fresh.read(in5);
+        assert(fresh == bitset);
+
+        // zero-copy view on (64 byte aligned) memory, like a mapped file
+        std::vector<uint64_t> buffer(image.size()/8 + 1);
+        std::memcpy(buffer.data(), image.data(), image.size());
+        ViewStorage storage(buffer.data(), image.size());
+        assert(storage.getNBits() == nbits);
+        ViewBF view(static_cast<TestSizeT>(storage.getNBits()), storage);
+        assert(reinterpret_cast<const char *>(view.getBlocks()) == reinterpret_cast<const char *>(buffer.data()) + sizeof(onewayformat::Header) || nbits == 0);
+        checkAgainstReference(view, ref);
+        ViewBF copy(view); // heap memory
+        if (nbits > 0) {
+            copy.set(0);
+            assert(copy.get(0) && view.get(0) == ref[0] && copy.getBlocks() != view.getBlocks());
+        }
+        view = copy; // same size, so copied into the buffer
+        std::stringstream viewStream;
+        view.write(viewStream);
+        assert(viewStream.str().compare(sizeof(onewayformat::Header), std::string::npos, reinterpret_cast<const char *>(buffer.data()) + sizeof(onewayformat::Header), bitset.getNBytes()) == 0);
+    }
+
+    // errors
+    std::stringstream stream;
+    BF(100).write(stream);
+    std::string image = stream.str();
+    BF bitset;
+    bool thrown = false;
+    try { std::istringstream in(image.substr(0, image.size()-1)); bitset.read(in); } catch (const std::runtime_error &) { thrown = true; }
+    assert(thrown); // truncated
+    thrown = false;
+    image[0] = 'X';
+    try { std::istringstream in(image); bitset.read(in); } catch (const std::runtime_error &) { thrown = true; }
+    assert(thrown); // no magic
+    thrown = false;
+    std::vector<uint64_t> buffer(image.size()/8 + 1);
+    BF(100).write(stream);
+    std::memcpy(buffer.data(), stream.str().data() + image.size(), image.size());
+    try { ViewStorage storage(buffer.data(), image.size()); ViewBF view(50 + 64*8, storage); } catch (const std::runtime_error &) { thrown = true; }
+    assert(thrown); // size mismatch
+    std::cout << "Done." << std::endl;
 }
 
 
@@ -84,6 +1144,53 @@ int main () {
     const TestSizeT testIndex1 = 7;
     const TestSizeT testIndex2 = 16;
 
+    checkBlockKernels();
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary> >("summary");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::dirtylist> >("dirtylist");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary | onewayopt::dirtylist> >("summary+dirtylist");
+    checkVariant< EpochBitset<TestSizeT, TestAllocT> >("epoch");
+    checkVariant< CompressedOnewayBitset<TestSizeT> >("compressed");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::none, AlignedStorage<>> >("aligned");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::dirtylist, HugePageStorage> >("hugepage+dirtylist");
+    checkVariant< CowOnewayBitset<TestSizeT, TestAllocT, 64> >("copy-on-write");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting> >("counting");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting | onewayopt::summary | onewayopt::dirtylist> >("counting+summary+dirtylist");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::streaming> >("streaming");
+    checkVariant< OnewayBitset<TestSizeT, TestAllocT, onewayopt::streaming | onewayopt::counting, AlignedStorage<>> >("streaming+counting+aligned");
+    checkCompressedContainers();
+    checkBulkSetters< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkBulkSetters< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary> >("summary");
+    checkBulkSetters< OnewayBitset<TestSizeT, TestAllocT, onewayopt::dirtylist> >("dirtylist");
+    checkBulkSetters< OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting | onewayopt::summary> >("counting+summary");
+    checkMergeAll< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkSetAlgebra< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkExpressions< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkExpressions< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary | onewayopt::dirtylist> >("summary+dirtylist");
+    checkSetAlgebra< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary> >("summary");
+    checkMoveAndCapacity< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkFindRankSelect< OnewayBitset<TestSizeT, TestAllocT> >("plain");
+    checkFindRankSelect< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary> >("summary");
+    checkMoveAndCapacity< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary | onewayopt::dirtylist> >("summary+dirtylist");
+    checkMergeAll< OnewayBitset<TestSizeT, TestAllocT, onewayopt::summary | onewayopt::dirtylist> >("summary+dirtylist");
+    checkMergeAll< OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting> >("counting");
+    checkExpressions< OnewayBitset<TestSizeT, TestAllocT, onewayopt::counting> >("counting");
+    checkFixedBitset<1, uint8_t>();
+    checkFixedBitset<17, uint8_t>();
+    checkFixedBitset<64, uint64_t>();
+    checkFixedBitset<100, uint32_t>();
+    checkFixedBitset<1000, uint64_t>();
+    checkEpochWrapAround();
+    checkAtomicConcurrentSet();
+    checkParallelOps();
+    checkCounting();
+    checkShardedBitset();
+    checkMultiMask();
+    checkSnapshots();
+    checkAllocatorStorage();
+    checkMappedFileStorage();
+    checkSerialization();
+
     TestBF testset1(nbits);
     TestBF testset2(nbits);
     TestBF testset3(nbits);
@@ -166,10 +1273,8 @@ int main () {
 
     cout << "Now we perform some operations on one or both bitsets:" << endl << endl;
 
-    cout << "Setting every third bit of first bitset, element-wise..." << endl;
-    for (TestSizeT i=0; i<testset4.getNBits(); i+=3) {
-        testset4.set(i);
-    }
+    cout << "Setting every third bit of first bitset, block-wise..." << endl;
+    testset4.setStrided(0, 3);
     cout << "Done." << endl << endl;
 
     cout << "Counting first bitset..." << endl;
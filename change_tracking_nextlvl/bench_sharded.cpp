@@ -0,0 +1,180 @@
+#include "../change_tracking/tracking.hpp"
+#include "../bitsets/OnewayBitset.hpp"
+#include "../bitsets/AtomicOnewayBitset.hpp"
+#include "../bitsets/ShardedOnewayBitset.hpp"
+#include "../bitsets/ThreadPool.hpp"
+#include "../common/Timer.hpp"
+#include "../common/benchtools.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+
+// Thread scaling of change tracking with one shared vs per-thread change masks
+//
+// A parallel version of the sampler in main.cpp: every step, each of nthreads threads proposes
+// new values for its contiguous slice of the coordinates of one big walker. A changed coordinate i
+// invalidates its own term i of the observable and a coupled term (i*7919) % ndim (think of a
+// pair interaction), so every thread marks terms all over the mask. Then the threads recompute
+// the marked terms of their slice of the observable, and the mask is reset for the next step.
+//
+// We compare the following approaches:
+// Approach 1 (Atomic): All threads set bits in one shared AtomicOnewayBitset. The mask is read
+//            directly by the observable threads and reset sequentially (it's not thread-safe).
+// Approach 2 (Sharded): Every thread sets bits in its own shard of a ShardedOnewayBitset, which
+//            are OR-reduced in parallel into the result mask before the observable is computed.
+//            Shards and result are reset in parallel.
+//
+// The following settings are configured:
+// 10 runs per benchmark, 100 steps per run, a walker with 10^6 dimensions,
+// change thresholds of 0.01, 0.1 and 0.5, and 1, 2, 4, ... up to the number of hardware threads.
+//
+// Expectation: With one thread both should perform the same, apart from the extra reduction pass.
+// With more threads, the atomic mask turns every set() into a cache line transfer (the coupled
+// terms of all threads hit the same lines), which should hurt most for dense steps. The sharded
+// mask sets without any sharing, at the price of reading nthreads shards once per step.
+// Result (1 core VM, so only the 1 thread numbers are meaningful): both take the same time
+// within 5%, the reduction pass is invisible next to the observable (15 to 90 ms per step
+// for the given thresholds). The scaling still has to be measured on a multi-core machine.
+
+using BenchSizeT = uint64_t;
+using BenchAllocT = uint64_t;
+using AtomicMask = AtomicOnewayBitset<BenchSizeT, BenchAllocT>;
+using ShardedMask = ShardedOnewayBitset<BenchSizeT, BenchAllocT>;
+
+
+// --- Parallel sampler ---
+
+inline double next_uniform(uint64_t &state)
+{
+    state = state*6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<double>(state >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+}
+
+inline void slice(const int t, const int nthreads, const BenchSizeT ndim, BenchSizeT &first, BenchSizeT &last)
+{
+    first = ndim*t/nthreads;
+    last = ndim*(t+1)/nthreads;
+}
+
+template <class SetFn>
+void newPositionParallel(const int t, const int nthreads, std::vector<double> &x, uint64_t &state, const double changeThreshold, SetFn && setChanged)
+{
+    const BenchSizeT ndim = x.size();
+    BenchSizeT first, last;
+    slice(t, nthreads, ndim, first, last);
+    for (BenchSizeT i=first; i<last; ++i) {
+        if (next_uniform(state) < changeThreshold) {
+            x[i] += next_uniform(state) - 0.5;
+            setChanged(i);
+            setChanged((i*7919) % ndim); // coupled term
+        }
+    }
+}
+
+template <class MaskT>
+double calcObsParallel(const int t, const int nthreads, const std::vector<double> &x, const MaskT &mask, std::vector<double> &lastObs)
+{
+    BenchSizeT first, last;
+    slice(t, nthreads, x.size(), first, last);
+    double obs = 0.;
+    for (BenchSizeT i=first; i<last; ++i) {
+        if (mask.get(i)) { lastObs[i] = calcObsElement(x[i]); }
+        obs += lastObs[i];
+    }
+    return obs;
+}
+
+double sampleAtomicTrack(ThreadPool &pool, const int nsteps, const BenchSizeT ndim, const double changeThreshold)
+{
+    const int nthreads = pool.size();
+    std::vector<double> x(ndim, 0.), lastObs(ndim, 0.), partial(8*nthreads, 0.);
+    std::vector<uint64_t> states(8*nthreads); // one cache line per thread
+    for (int t=0; t<nthreads; ++t) { states[8*t] = 1337 + t; }
+    AtomicMask mask(ndim);
+    mask.setAll();
+
+    double obs = 0.;
+    for (int step=0; step<nsteps; ++step) {
+        pool.run([&](const int t) {
+            if (step > 0) { newPositionParallel(t, nthreads, x, states[8*t], changeThreshold, [&mask](const BenchSizeT i) { mask.set(i); }); }
+        });
+        pool.run([&](const int t) { partial[8*t] = calcObsParallel(t, nthreads, x, mask, lastObs); });
+        for (int t=0; t<nthreads; ++t) { obs += partial[8*t]; }
+        mask.reset();
+    }
+    return obs;
+}
+
+double sampleShardedTrack(ThreadPool &pool, const int nsteps, const BenchSizeT ndim, const double changeThreshold)
+{
+    const int nthreads = pool.size();
+    std::vector<double> x(ndim, 0.), lastObs(ndim, 0.), partial(8*nthreads, 0.);
+    std::vector<uint64_t> states(8*nthreads);
+    for (int t=0; t<nthreads; ++t) { states[8*t] = 1337 + t; }
+    ShardedMask mask(ndim, pool);
+    mask.shard(0).setAll();
+
+    double obs = 0.;
+    for (int step=0; step<nsteps; ++step) {
+        pool.run([&](const int t) {
+            ShardedMask::BitsetT &shard = mask.shard(t);
+            if (step > 0) { newPositionParallel(t, nthreads, x, states[8*t], changeThreshold, [&shard](const BenchSizeT i) { shard.set(i); }); }
+        });
+        mask.reduce(pool);
+        pool.run([&](const int t) { partial[8*t] = calcObsParallel(t, nthreads, x, mask.getResult(), lastObs); });
+        for (int t=0; t<nthreads; ++t) { obs += partial[8*t]; }
+        mask.reset(pool);
+    }
+    return obs;
+}
+
+
+// --- Benchmark execution ---
+
+void run_single_benchmark(const std::string &label, const bool sharded, const int nthreads, const int nruns, const int nsteps, const BenchSizeT ndim, const double changeThreshold)
+{
+    ThreadPool pool(nthreads);
+    Timer timer(1.);
+    const double time_scale = 1000000.; //microseconds
+    std::pair<double, double> result = sample_benchmark([&] {
+        timer.reset();
+        const double obs = sharded ? sampleShardedTrack(pool, nsteps, ndim, changeThreshold) : sampleAtomicTrack(pool, nsteps, ndim, changeThreshold);
+        const double time = timer.elapsed();
+        std::cout << obs << " ";
+        return time;
+    }, nruns);
+    std::cout << std::endl << label << ":" << std::setw(std::max(1, 44-static_cast<int>(label.length()))) << std::setfill(' ') << " " << result.first/nsteps*time_scale << " +- " << result.second/nsteps*time_scale << " microseconds" << std::endl << std::endl;
+}
+
+
+// --- Main program ---
+
+int main () {
+    // benchmark settings
+    const int nruns = 10;
+    const int nsteps = 100;
+    const BenchSizeT ndim = 1000000;
+    const double changeThresholds[3] = {0.01, 0.1, 0.5};
+    const int maxthreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::cout << "=========================================================================================" << std::endl << std::endl;
+    std::cout << "Benchmark results (time per sample):" << std::endl;
+
+    for (auto & threshold : changeThresholds) {
+        for (int nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+            const std::string settings = std::to_string(nthreads) + " threads, thresh " + std::to_string(threshold);
+            run_single_benchmark("t/step ( atomic, " + settings + " )", false, nthreads, nruns, nsteps, ndim, threshold);
+            run_single_benchmark("t/step ( sharded, " + settings + " )", true, nthreads, nruns, nsteps, ndim, threshold);
+        }
+    }
+    std::cout << "=========================================================================================" << std::endl << std::endl << std::endl;
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #!/bin/sh
 
 . ./config.sh
-${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -o exe main.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o exe main.cpp
+${CXX_COMPILER} ${CXX_FLAGS} -std=c++14 -pthread -o bench_sharded bench_sharded.cpp
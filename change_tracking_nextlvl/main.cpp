@@ -10,6 +10,8 @@
 #include <cmath>
 #include <algorithm>
 #include <functional>
+#include <cstdlib>
+#include <new>
 
 
 // Next level of change tracking benchmark (see ../change_tracking)
@@ -25,6 +27,15 @@
 // Approach 3 (Bitset (int8)): Like approach 2, but using a OnewayBitset with blocks of 1 byte.
 // Approach 4 (Bitset (int64)): Like approach 3, but using blocks of 8 byte.
 // Approach 5:(Bitvector): Like approach 2, but using a std::vector<bool>.
+// Approach 6 (Bitset (int64, summary)): Like approach 4, but with the summary
+//            layer of OnewayBitset, so that sparse steps skip untouched blocks.
+// Approach 7 (Bitset (int64, dirtylist)): Like approach 4, but reset() only
+//            zeroes the blocks that were dirtied during the step.
+// Approach 8 (Fixed bitset (int64)): Like approach 4, but with a FixedOnewayBitset,
+//            i.e. ndim is a compile-time constant and the bitset lives on the stack.
+// Approach 9 (Bitset (int64, counting)): Like approach 4, but with onewayopt::counting,
+//            so count() is O(1) and every step can choose between visiting the set bits
+//            and recomputing all coordinates (if more than half of them changed).
 //
 // The following settings are configured:
 // 10 runs per benchmark, 10000 steps per run.
@@ -46,14 +57,44 @@
 // the measured time contains the time spent on random number generation and
 // the expensive observable, not the bitsets. For a more direct bitset
 // benchmark, see ../bitsets .
+//
+// Note 3: The global operator new is replaced by a counting one, to print the number
+// of heap allocations per run next to the time. All approaches should allocate only
+// a constant number of times per run (i.e. never per step), which is what the move
+// and capacity reuse of OnewayBitset are meant to guarantee when masks get assigned.
+//
+// Note 4: Approach 9 is not faster than approach 4 (within the noise for all thresholds),
+// even though it saves the set bit extraction on dense steps. The step time is dominated
+// by rand() and the observable, and forEachSet() is already cheap for 1000 bits. The O(1)
+// count() pays off where a scan of the mask would be expensive (large masks, see ../bitsets).
+
+
+// --- Allocation counting ---
+
+static unsigned long alloc_count = 0; // number of calls to operator new (not thread-safe, we are single-threaded)
+
+void * operator new(std::size_t size)
+{
+    ++alloc_count;
+    if (void * p = std::malloc(size > 0 ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+void * operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete[](void * p) noexcept { std::free(p); }
+void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::size_t) noexcept { std::free(p); }
 
 // --- Benchmark execution ---
 
-double benchmark_tracking_nextlvl(const int trackingType /* 1 notrack 2 track 3 bitset track */, const int nsteps, const int ndim, const double changeThreshold) {
+constexpr int fixed_ndim = 1000; // ndim for approach 8, which needs it at compile time
+
+double benchmark_tracking_nextlvl(const int trackingType /* 1 notrack 2 track 3/4/6/7/8/9 bitset track 5 boolvec track */, const int nsteps, const int ndim, const double changeThreshold) {
     Timer timer(1.);
     double obs;
 
     srand(1337);
+    const unsigned long allocs_before = alloc_count;
     timer.reset();
     if (trackingType == 1) {
         obs = sampleNoTrack(nsteps, ndim, changeThreshold);
@@ -63,12 +104,20 @@ double benchmark_tracking_nextlvl(const int trackingType /* 1 notrack 2 track 3
         obs = sampleBitsetTrack<int, uint8_t>(nsteps, ndim, changeThreshold);
     } else if (trackingType == 4) {
         obs = sampleBitsetTrack<int, uint64_t>(nsteps, ndim, changeThreshold);
+    } else if (trackingType == 6) {
+        obs = sampleBitsetTrack<int, uint64_t, onewayopt::summary>(nsteps, ndim, changeThreshold);
+    } else if (trackingType == 7) {
+        obs = sampleBitsetTrack<int, uint64_t, onewayopt::dirtylist>(nsteps, ndim, changeThreshold);
+    } else if (trackingType == 8) {
+        obs = sampleFixedBitsetTrack<fixed_ndim, uint64_t>(nsteps, changeThreshold); // ndim == fixed_ndim
+    } else if (trackingType == 9) {
+        obs = sampleBitsetAdaptiveTrack<int, uint64_t>(nsteps, ndim, changeThreshold);
     } else {
         obs = sampleBoolvecTrack(nsteps, ndim, changeThreshold);
     }
     const double time = timer.elapsed();
 
-    std::cout << obs;
+    std::cout << obs << " (" << alloc_count - allocs_before << " allocs) ";
     return time;
 }
 
@@ -88,7 +137,7 @@ int main () {
     // benchmark settings
     const int nruns = 10;
     const int nsteps = 5000;
-    const int ndim = 1000;
+    const int ndim = fixed_ndim;
     const double changeThresholds[4] = {1./ndim, 5./ndim, 0.5, 1.};
 
     std::cout << "=========================================================================================" << std::endl << std::endl;
@@ -96,7 +145,7 @@ int main () {
 
     // tracking benchmark
     for (auto & threshold : changeThresholds) {
-        for (int trackType = 2; trackType < 6; ++trackType) {
+        for (int trackType = 2; trackType < 10; ++trackType) {
             run_single_benchmark("t/step ( type " + std::to_string(trackType) + ", thresh " + std::to_string(threshold) + " )", trackType, nruns, nsteps, ndim, threshold);
         }
     }
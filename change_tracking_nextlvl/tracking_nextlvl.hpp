@@ -2,6 +2,7 @@
 #define TRACKING_NEXTLVL_HPP
 
 #include "../bitsets/OnewayBitset.hpp"
+#include "../bitsets/FixedOnewayBitset.hpp"
 
 #include "../change_tracking/tracking.hpp"
 
@@ -12,8 +13,8 @@
 
 // --- Cascade of functions that perform the bitset tracking approach ---
 
-template<typename SizeT, typename AllocT>
-void newPositionBitsetTrack(const int ndim, double x[], OnewayBitset<SizeT, AllocT> & flags_xchanged, const double changeThreshold)
+template<class BitsetT> // OnewayBitset or FixedOnewayBitset
+void newPositionBitsetTrack(const int ndim, double x[], BitsetT & flags_xchanged, const double changeThreshold)
 {
     for (int i=0; i<ndim; ++i) {
         if (rand()*(1.0 / RAND_MAX) < changeThreshold) {
@@ -34,19 +35,14 @@ void newPositionBoolvecTrack(const int ndim, double x[], std::vector<bool> &flag
 }
 
 
-template<typename SizeT, typename AllocT>
-double calcObsBitsetTrack(const int ndim, const double x[], const OnewayBitset<SizeT, AllocT> & flags_xchanged, double lastObs[])
+template<class BitsetT> // OnewayBitset or FixedOnewayBitset
+double calcObsBitsetTrack(const int ndim, const double x[], const BitsetT & flags_xchanged, double lastObs[])
 {
-    // make use of fast flag-based any()
+    // make use of fast flag-based any() and visit only the changed coordinates
     if (flags_xchanged.any()) {
-        double obs = 0.;
-        for (int i=0; i<ndim; ++i) {
-            if (flags_xchanged.get(i)) { lastObs[i] = calcObsElement(x[i]); }
-            obs += lastObs[i];
-        }
-        return obs;
+        flags_xchanged.forEachSet([&](const auto i) { lastObs[i] = calcObsElement(x[i]); });
     }
-    else { return std::accumulate(lastObs, lastObs+ndim, 0.); }
+    return std::accumulate(lastObs, lastObs+ndim, 0.);
 
     /* other approach
     double obs = 0.;
@@ -67,6 +63,20 @@ double calcObsBitsetTrack(const int ndim, const double x[], const OnewayBitset<S
     */
 }
 
+template<class BitsetT> // OnewayBitset with onewayopt::counting
+double calcObsBitsetAdaptive(const int ndim, const double x[], const BitsetT & flags_xchanged, double lastObs[])
+{
+    // count() is O(1) with counting, so we can choose per step: if most coordinates
+    // changed, a plain loop with bit tests beats extracting the set bits one by one
+    if (2*flags_xchanged.count() > ndim) {
+        for (int i=0; i<ndim; ++i) { if (flags_xchanged.get(i)) { lastObs[i] = calcObsElement(x[i]); } }
+    }
+    else if (flags_xchanged.any()) {
+        flags_xchanged.forEachSet([&](const auto i) { lastObs[i] = calcObsElement(x[i]); });
+    }
+    return std::accumulate(lastObs, lastObs+ndim, 0.);
+}
+
 double calcObsBoolvecTrack(const int ndim, const double x[], const std::vector<bool> & flags_xchanged, double lastObs[])
 {
     double obs = 0.;
@@ -78,13 +88,54 @@ double calcObsBoolvecTrack(const int ndim, const double x[], const std::vector<b
 }
 
 
-template<typename SizeT, typename AllocT>
+template<typename SizeT, typename AllocT, unsigned Opts = onewayopt::none>
 double sampleBitsetTrack(const int nsteps, const int ndim, const double changeThreshold)
 {
     double obs = 0.;
     double x[ndim];
     double lastObs[ndim];
-    OnewayBitset<SizeT, AllocT> flags_xchanged(ndim);
+    OnewayBitset<SizeT, AllocT, Opts> flags_xchanged(ndim);
+
+    std::fill(x, x+ndim, 0.);
+    std::fill(lastObs, lastObs+ndim, 0.);
+    flags_xchanged.setAll();
+
+    for (int i=0; i<nsteps; ++i) {
+        newPositionBitsetTrack(ndim, x, flags_xchanged, changeThreshold);
+        obs += calcObsBitsetTrack(ndim, x, flags_xchanged, lastObs);
+        flags_xchanged.reset();
+    }
+    return obs;
+}
+
+template<typename SizeT, typename AllocT>
+double sampleBitsetAdaptiveTrack(const int nsteps, const int ndim, const double changeThreshold)
+{   // like sampleBitsetTrack, but choosing between sparse and dense evaluation per step
+    double obs = 0.;
+    double x[ndim];
+    double lastObs[ndim];
+    OnewayBitset<SizeT, AllocT, onewayopt::counting> flags_xchanged(ndim);
+
+    std::fill(x, x+ndim, 0.);
+    std::fill(lastObs, lastObs+ndim, 0.);
+    flags_xchanged.setAll();
+
+    for (int i=0; i<nsteps; ++i) {
+        newPositionBitsetTrack(ndim, x, flags_xchanged, changeThreshold);
+        obs += calcObsBitsetAdaptive(ndim, x, flags_xchanged, lastObs);
+        flags_xchanged.reset();
+    }
+    return obs;
+}
+
+template<size_t NDim, typename AllocT>
+double sampleFixedBitsetTrack(const int nsteps, const double changeThreshold)
+{   // like sampleBitsetTrack, but with ndim known at compile time
+    constexpr int ndim = static_cast<int>(NDim);
+    double obs = 0.;
+    double x[ndim];
+    double lastObs[ndim];
+    FixedOnewayBitset<NDim, AllocT> flags_xchanged;
 
     std::fill(x, x+ndim, 0.);
     std::fill(lastObs, lastObs+ndim, 0.);